@@ -0,0 +1,257 @@
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+//Live instance and byte counts for a single class. Updated from any thread.
+class AllocationCounter
+{
+public:
+    AllocationCounter(const char* name, size_t index)
+    : name(name), index(index)
+    {
+    }
+
+    void add(int64_t size)
+    {
+        int64_t now_live = ++live;
+        bytes += size;
+        total++;
+        int64_t high = high_water;
+        while(now_live > high && !high_water.compare_exchange_weak(high, now_live))
+        {
+        }
+    }
+
+    void remove(int64_t size)
+    {
+        live--;
+        bytes -= size;
+    }
+
+    const char* name;
+    size_t index; //Order in which the classes were first seen.
+    std::atomic<int64_t> live{0};
+    std::atomic<int64_t> high_water{0};
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> total{0};
+    std::atomic<int64_t> day_start_live{0};
+};
+
+class AllocationTracker
+{
+public:
+    static AllocationTracker& get()
+    {
+        static AllocationTracker instance;
+        return instance;
+    }
+
+    AllocationCounter& getCounter(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& counter : counters)
+        {
+            if (strcmp(counter->name, name) == 0)
+                return *counter;
+        }
+        counters.emplace_back(new AllocationCounter(name, counters.size()));
+        return *counters.back();
+    }
+
+    //Remember the current live counts, the per day delta is relative to this.
+    void markDay()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& counter : counters)
+            counter->day_start_live = int64_t(counter->live);
+    }
+
+    std::vector<std::pair<sp::string, int64_t>> getLiveCounts()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::pair<sp::string, int64_t>> result;
+        for(auto& counter : counters)
+            result.emplace_back(counter->name, int64_t(counter->live));
+        return result;
+    }
+
+    //Number of tracked objects ever created, over all classes.
+    int64_t getTotalCreated()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t result = 0;
+        for(auto& counter : counters)
+            result += counter->total;
+        return result;
+    }
+
+    //Bytes of all live tracked objects, over all classes.
+    int64_t getLiveBytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t result = 0;
+        for(auto& counter : counters)
+            result += counter->bytes;
+        return result;
+    }
+
+    //One line per class: live count, high-water mark, live bytes and the change in live count since the last markDay().
+    std::vector<sp::string> getReport()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<sp::string> result;
+        for(auto& counter : counters)
+        {
+            int64_t live = counter->live;
+            int64_t delta = live - counter->day_start_live;
+            result.push_back(sp::string(counter->name) + ": " + sp::string(int(live)) + " live, " + sp::string(int(counter->high_water)) + " max, "
+                + sp::string(int(counter->bytes)) + " bytes, " + (delta >= 0 ? "+" : "") + sp::string(int(delta)) + " today");
+        }
+        return result;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<AllocationCounter>> counters;
+};
+
+//Live counts of the tracked objects of a single session. Objects count for the scope that is current on the thread that creates them,
+//so sessions that run side by side on the worker threads of a SessionHost are measured apart.
+class AllocationScope
+{
+public:
+    AllocationScope(const sp::string& tag)
+    : tag(tag)
+    {
+    }
+
+    void add(const AllocationCounter& counter)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        get(counter).live++;
+    }
+
+    void remove(const AllocationCounter& counter)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        get(counter).live--;
+    }
+
+    //Remember the current live counts, the per day delta is relative to this.
+    void markDay()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& count : counts)
+            count.day_start_live = count.live;
+    }
+
+    //Live count per class, in the order the classes were first seen in the process.
+    std::vector<std::pair<sp::string, int64_t>> getLiveCounts()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::pair<sp::string, int64_t>> result;
+        for(auto& count : counts)
+            result.emplace_back(count.name ? count.name : "", count.live);
+        return result;
+    }
+
+    //A single line: the tag, then the live count of every class and its change since the last markDay().
+    sp::string getDayReport()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sp::string result = tag + ":";
+        for(auto& count : counts)
+        {
+            if (!count.name)
+                continue;
+            int64_t delta = count.live - count.day_start_live;
+            result += " " + sp::string(count.name) + " " + sp::string(int(count.live)) + " (" + (delta >= 0 ? "+" : "") + sp::string(int(delta)) + ")";
+        }
+        return result;
+    }
+
+    //The scope of objects created on this thread, empty for none.
+    static std::shared_ptr<AllocationScope>& current()
+    {
+        static thread_local std::shared_ptr<AllocationScope> scope;
+        return scope;
+    }
+
+    //Makes a scope current on this thread for as long as it exists.
+    class Enter
+    {
+    public:
+        Enter(std::shared_ptr<AllocationScope> scope)
+        : previous(current())
+        {
+            current() = scope;
+        }
+
+        Enter(const Enter&) = delete;
+        Enter& operator=(const Enter&) = delete;
+
+        ~Enter()
+        {
+            current() = previous;
+        }
+
+    private:
+        std::shared_ptr<AllocationScope> previous;
+    };
+
+    const sp::string tag;
+
+private:
+    struct Count
+    {
+        const char* name = nullptr;
+        int64_t live = 0;
+        int64_t day_start_live = 0;
+    };
+
+    Count& get(const AllocationCounter& counter)
+    {
+        if (counts.size() <= counter.index)
+            counts.resize(counter.index + 1);
+        counts[counter.index].name = counter.name;
+        return counts[counter.index];
+    }
+
+    std::mutex mutex;
+    std::vector<Count> counts;
+};
+
+//Member that counts the lifetime of the object it is part of:
+//  AllocationTag<Adventurer> allocation_tag{"Adventurer"};
+template<typename T> class AllocationTag
+{
+public:
+    AllocationTag(const char* name)
+    : counter(getCounter(name)), scope(AllocationScope::current())
+    {
+        counter.add(sizeof(T));
+        if (scope)
+            scope->add(counter);
+    }
+
+    AllocationTag(const AllocationTag&) = delete;
+    AllocationTag& operator=(const AllocationTag&) = delete;
+
+    ~AllocationTag()
+    {
+        counter.remove(sizeof(T));
+        if (scope)
+            scope->remove(counter);
+    }
+
+    static AllocationCounter& getCounter(const char* name)
+    {
+        static AllocationCounter& counter = AllocationTracker::get().getCounter(name);
+        return counter;
+    }
+
+private:
+    AllocationCounter& counter;
+    std::shared_ptr<AllocationScope> scope;
+};
@@ -0,0 +1,361 @@
+//Searches for scenarios with pathological fixed update times: big mazes for the room scans, long backtracks,
+//rooms full of fire traps, hordes of adventurers. Generates random scenarios and mutates the worst ones found so far,
+//then shrinks the worst of all while they stay slow, so they can be saved as small reproducible scenario files.
+//Generation and mutation only depend on the seed. The timings do not, so the results of two runs with the same seed can differ.
+//Rooms of the scenarios are always kept in breadth first order from the entrance, see removeUnreachable().
+class DungeonFuzzer
+{
+public:
+    static constexpr int max_rooms = 200;
+    static constexpr int population_size = 8;
+    //Runs per measurement. The slowest run is noise as often as not, so the middle one is used.
+    static constexpr int measure_runs = 3;
+    //A smaller scenario replaces the worst case as long as it keeps this much of its score.
+    static constexpr double minimise_keep_ratio = 0.8;
+    static constexpr int max_minimise_evaluations = 60;
+
+    struct Candidate
+    {
+        Scenario scenario;
+        ScenarioResult result;
+    };
+
+    DungeonFuzzer(uint32_t seed)
+    : seed(seed), random_engine(seed)
+    {
+    }
+
+    //What we are hunting for: slow fixed updates that keep coming back. The single worst tick is mostly a page fault or
+    //the scheduler, a p99 that stays high over the median of measure_runs runs is something the game does. The max is only reported.
+    static double score(const ScenarioResult& result)
+    {
+        return result.p99_tick;
+    }
+
+    //Run the search, and return the minimised worst keep candidates, worst first.
+    std::vector<Candidate> run(int iterations, int keep)
+    {
+        std::vector<Candidate> population;
+        for(int n=0; n<iterations; n++)
+        {
+            Candidate candidate;
+            if (int(population.size()) < population_size || irandom(0, 3) == 0)
+                candidate.scenario = generate();
+            else
+                candidate.scenario = mutate(population[irandom(0, population.size() - 1)].scenario);
+            candidate.result = measure(candidate.scenario);
+            if (population.empty() || score(candidate.result) > score(population.front().result))
+                LOG(Info, "Fuzz", n, "new worst:", describe(candidate));
+            population.push_back(candidate);
+            std::sort(population.begin(), population.end(), [](const Candidate& a, const Candidate& b) { return score(a.result) > score(b.result); });
+            if (population.size() > population_size)
+                population.pop_back();
+        }
+
+        population.resize(std::min(size_t(keep), population.size()));
+        for(auto& candidate : population)
+        {
+            candidate = minimise(candidate.scenario);
+            LOG(Info, "Fuzz minimised:", describe(candidate));
+        }
+        std::sort(population.begin(), population.end(), [](const Candidate& a, const Candidate& b) { return score(a.result) > score(b.result); });
+        return population;
+    }
+
+    //Save candidates as <prefix>1.scenario, <prefix>2.scenario, ...
+    void save(const std::vector<Candidate>& candidates, const sp::string& prefix)
+    {
+        for(size_t n=0; n<candidates.size(); n++)
+        {
+            const Candidate& candidate = candidates[n];
+            sp::string filename = prefix + sp::string(int(n + 1)) + ".scenario";
+            Scenario scenario = candidate.scenario;
+            std::vector<sp::string> comments;
+            comments.push_back("Found by the dungeon fuzzer, seed " + sp::string(int(seed)));
+            comments.push_back(describe(candidate));
+            if (scenario.save(filename, comments))
+                LOG(Info, "Saved", filename);
+        }
+    }
+
+    Scenario generate()
+    {
+        Scenario scenario;
+        scenario.seed = random_engine();
+        scenario.days = irandom(1, 2);
+
+        //Random walk from the entrance. Continuing from the last room makes corridors, a random room makes mazes.
+        std::set<std::pair<int, int>> build{{0, 0}};
+        std::vector<std::pair<int, int>> order{{0, 0}};
+        int room_count = irandom(1, max_rooms);
+        float corridor_chance = frandom(0.0f, 1.0f);
+        for(int attempt=0; int(build.size()) < room_count && attempt < room_count * 20; attempt++)
+        {
+            std::pair<int, int> from = frandom(0.0f, 1.0f) < corridor_chance ? order.back() : order[irandom(0, order.size() - 1)];
+            std::pair<int, int> next = neighbour(from, irandom(0, 3));
+            if (next.first >= 0 && build.insert(next).second)
+                order.push_back(next);
+        }
+
+        float trap_chance = frandom(0.0f, 1.0f);
+        for(auto& position : order)
+        {
+            ScenarioRoom room{position.first, position.second, "", 0};
+            if (frandom(0.0f, 1.0f) < trap_chance)
+                randomObject(room);
+            if (position != std::make_pair(0, 0) || !room.object.empty())
+                scenario.rooms.push_back(room);
+        }
+        removeUnreachable(scenario);
+
+        scenario.money = irandom(0, 1000);
+        scenario.risk = frandom(0.0f, 20.0f);
+        scenario.reward = frandom(0.0f, 20.0f);
+        scenario.dragon_deception = frandom(0.0f, 20.0f);
+        scenario.placable_bodies = irandom(0, 5);
+        scenario.spawn_count = irandom(0, 1) ? 0 : irandom(2, 60);
+        scenario.max_level = irandom(0, 10);
+        scenario.spawn_delay_min = irandom(1, 80);
+        scenario.spawn_delay_max = scenario.spawn_delay_min + irandom(0, 80);
+        return scenario;
+    }
+
+    Scenario mutate(Scenario scenario)
+    {
+        switch(irandom(0, 7))
+        {
+        case 0: //Dig a room next to a random room.
+            for(int attempt=0; attempt<20 && int(scenario.rooms.size()) < max_rooms; attempt++)
+            {
+                std::pair<int, int> from{0, 0};
+                if (!scenario.rooms.empty() && irandom(0, 3))
+                {
+                    const ScenarioRoom& room = scenario.rooms[irandom(0, scenario.rooms.size() - 1)];
+                    from = std::make_pair(room.x, room.y);
+                }
+                std::pair<int, int> next = neighbour(from, irandom(0, 3));
+                if (next.first >= 0 && next != std::make_pair(0, 0) && !findRoom(scenario, next.first, next.second) && findConnected(scenario, next))
+                {
+                    scenario.rooms.push_back({next.first, next.second, "", 0});
+                    removeUnreachable(scenario);
+                    break;
+                }
+            }
+            break;
+        case 1: //Remove a room, and everything that was only reachable through it.
+            if (!scenario.rooms.empty())
+            {
+                scenario.rooms.erase(scenario.rooms.begin() + irandom(0, scenario.rooms.size() - 1));
+                removeUnreachable(scenario);
+            }
+            break;
+        case 2: //Put a different object in a room.
+            if (!scenario.rooms.empty())
+                randomObject(scenario.rooms[irandom(0, scenario.rooms.size() - 1)]);
+            break;
+        case 3: //Clear a room.
+            if (!scenario.rooms.empty())
+            {
+                ScenarioRoom& room = scenario.rooms[irandom(0, scenario.rooms.size() - 1)];
+                room.object = "";
+                room.state = 0;
+            }
+            break;
+        case 4:
+            scenario.spawn_count = std::max(0, std::min(100, scenario.spawn_count + irandom(-5, 10)));
+            break;
+        case 5:
+            scenario.max_level = std::max(0, std::min(20, scenario.max_level + irandom(-2, 3)));
+            break;
+        case 6:
+            scenario.spawn_delay_min = std::max(1, scenario.spawn_delay_min + irandom(-20, 20));
+            scenario.spawn_delay_max = std::max(scenario.spawn_delay_min, scenario.spawn_delay_max + irandom(-20, 20));
+            break;
+        case 7:
+            scenario.seed = random_engine();
+            break;
+        }
+        return scenario;
+    }
+
+    //Shrink a scenario step by step while it stays slow. The first reduction that keeps enough of the score is taken,
+    //and the search starts again from the smaller scenario, until no reduction is left or the evaluation budget is used up.
+    Candidate minimise(Scenario scenario)
+    {
+        Candidate best{scenario, measure(scenario)};
+        double target = score(best.result) * minimise_keep_ratio;
+        int evaluations = 0;
+        bool progress = true;
+        while(progress && evaluations < max_minimise_evaluations)
+        {
+            progress = false;
+            for(auto& reduced : reductions(best.scenario))
+            {
+                if (evaluations++ >= max_minimise_evaluations)
+                    break;
+                ScenarioResult result = measure(reduced);
+                if (score(result) >= target)
+                {
+                    best = Candidate{reduced, result};
+                    progress = true;
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    static sp::string describe(const Candidate& candidate)
+    {
+        const ScenarioResult& result = candidate.result;
+        int objects = 0;
+        for(auto& room : candidate.scenario.rooms)
+        {
+            if (!room.object.empty())
+                objects++;
+        }
+        return "p99 tick " + sp::string(result.p99_tick * 1000.0, 3) + "ms, mean " + sp::string(result.mean_tick * 1000.0, 3)
+            + "ms, max " + sp::string(result.max_tick * 1000.0, 3) + "ms, " + sp::string(result.ticks) + " ticks, "
+            + sp::string(int(result.allocations)) + " allocations, at most " + sp::string(int(result.max_tick_allocations)) + " in a tick, "
+            + sp::string(int(candidate.scenario.rooms.size() + 1)) + " rooms, " + sp::string(objects) + " objects";
+    }
+
+private:
+    ScenarioResult measure(const Scenario& scenario)
+    {
+        return ScenarioRunner::runMedian(scenario, measure_runs, score);
+    }
+
+    //Smaller versions of a scenario, biggest reductions first.
+    std::vector<Scenario> reductions(const Scenario& scenario)
+    {
+        std::vector<Scenario> result;
+        if (scenario.days > 1)
+        {
+            result.push_back(scenario);
+            result.back().days = 1;
+        }
+        if (scenario.spawn_count > 2)
+        {
+            result.push_back(scenario);
+            result.back().spawn_count = std::max(2, scenario.spawn_count / 2);
+        }
+        if (scenario.max_level > 1)
+        {
+            result.push_back(scenario);
+            result.back().max_level = scenario.max_level / 2;
+        }
+        std::vector<size_t> objects;
+        for(size_t n=0; n<scenario.rooms.size(); n++)
+        {
+            if (!scenario.rooms[n].object.empty())
+                objects.push_back(n);
+        }
+        //Clear half of the objects, then single ones.
+        for(int half=0; half<2 && objects.size() > 1; half++)
+        {
+            result.push_back(scenario);
+            for(size_t n=half * objects.size() / 2; n<(half + 1) * objects.size() / 2; n++)
+                result.back().rooms[objects[n]].object = "";
+        }
+        for(auto index : objects)
+        {
+            result.push_back(scenario);
+            result.back().rooms[index].object = "";
+            result.back().rooms[index].state = 0;
+        }
+        //Drop the rooms furthest away, the second half in breadth first order, then single empty rooms.
+        if (scenario.rooms.size() > 1)
+        {
+            result.push_back(scenario);
+            result.back().rooms.resize(scenario.rooms.size() / 2);
+            removeUnreachable(result.back());
+        }
+        for(size_t n=0; n<scenario.rooms.size(); n++)
+        {
+            if (!scenario.rooms[n].object.empty())
+                continue;
+            result.push_back(scenario);
+            result.back().rooms.erase(result.back().rooms.begin() + n);
+            removeUnreachable(result.back());
+        }
+        return result;
+    }
+
+    void randomObject(ScenarioRoom& room)
+    {
+        static const char* objects[] = {"PIT", "LOOT", "FIRE", "SLIME", "BODY"};
+        room.object = objects[irandom(0, 4)];
+        room.state = (room.object == "SLIME" || room.object == "BODY") ? irandom(1, 5) : 0;
+    }
+
+    static std::pair<int, int> neighbour(std::pair<int, int> position, int direction)
+    {
+        static const int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+        return {position.first + offsets[direction][0], position.second + offsets[direction][1]};
+    }
+
+    static const ScenarioRoom* findRoom(const Scenario& scenario, int x, int y)
+    {
+        for(auto& room : scenario.rooms)
+        {
+            if (room.x == x && room.y == y)
+                return &room;
+        }
+        return nullptr;
+    }
+
+    static bool findConnected(const Scenario& scenario, std::pair<int, int> position)
+    {
+        for(int direction=0; direction<4; direction++)
+        {
+            std::pair<int, int> next = neighbour(position, direction);
+            if (next == std::make_pair(0, 0) || findRoom(scenario, next.first, next.second))
+                return true;
+        }
+        return false;
+    }
+
+    //Remove rooms that can no longer be reached from the entrance, and sort the rest in breadth first order from the entrance,
+    //so the rooms furthest away are at the end.
+    static void removeUnreachable(Scenario& scenario)
+    {
+        std::map<std::pair<int, int>, ScenarioRoom> todo;
+        for(auto& room : scenario.rooms)
+            todo[{room.x, room.y}] = room;
+        std::vector<ScenarioRoom> reachable;
+        auto entrance = todo.find({0, 0});
+        if (entrance != todo.end())
+        {
+            reachable.push_back(entrance->second);
+            todo.erase(entrance);
+        }
+        std::vector<std::pair<int, int>> open{{0, 0}};
+        for(size_t n=0; n<open.size(); n++)
+        {
+            for(int direction=0; direction<4; direction++)
+            {
+                auto it = todo.find(neighbour(open[n], direction));
+                if (it == todo.end() || it->first.first < 0)
+                    continue;
+                open.push_back(it->first);
+                reachable.push_back(it->second);
+                todo.erase(it);
+            }
+        }
+        scenario.rooms = reachable;
+    }
+
+    int irandom(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(random_engine);
+    }
+
+    float frandom(float min, float max)
+    {
+        return std::uniform_real_distribution<float>(min, max)(random_engine);
+    }
+
+    uint32_t seed;
+    std::mt19937 random_engine;
+};
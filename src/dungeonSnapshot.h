@@ -0,0 +1,192 @@
+#include <memory>
+
+//Immutable map from 32 bit keys to values, stored as a trie of 16-way nodes.
+//Changing an entry copies only the 8 nodes on the path to it, everything else is shared with the map it was copied from,
+//so copying a map is copying a single pointer, and copies can be read from any thread.
+template<typename T> class PersistentMap
+{
+public:
+    const T* find(uint32_t key) const
+    {
+        const Node* node = root.get();
+        for(int level=0; node && level<depth; level++)
+            node = node->children[slotIndex(key, level)].get();
+        return node ? node->value.get() : nullptr;
+    }
+
+    void set(uint32_t key, const T& value)
+    {
+        root = set(root, key, 0, std::make_shared<const T>(value));
+    }
+
+    void remove(uint32_t key)
+    {
+        root = set(root, key, 0, nullptr);
+    }
+
+    template<typename F> void forEach(F f) const
+    {
+        forEach(root, 0, f);
+    }
+
+    //Call f(old_value, new_value) for every key that differs between this map and other, with nullptr for a missing entry.
+    //Subtrees that are shared between the two maps are skipped without looking at them.
+    template<typename F> void forEachDifference(const PersistentMap& other, F f) const
+    {
+        forEachDifference(root, other.root, 0, f);
+    }
+
+private:
+    static constexpr int level_bits = 4;
+    static constexpr int slot_count = 1 << level_bits;
+    static constexpr int depth = 32 / level_bits;
+
+    struct Node
+    {
+        std::shared_ptr<const Node> children[slot_count];
+        std::shared_ptr<const T> value;
+    };
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    static int slotIndex(uint32_t key, int level)
+    {
+        return (key >> (32 - level_bits * (level + 1))) & (slot_count - 1);
+    }
+
+    static NodePtr set(const NodePtr& node, uint32_t key, int level, std::shared_ptr<const T> value)
+    {
+        if (level == depth)
+        {
+            if (!value)
+                return nullptr;
+            auto leaf = std::make_shared<Node>();
+            leaf->value = std::move(value);
+            return leaf;
+        }
+        auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+        int n = slotIndex(key, level);
+        copy->children[n] = set(copy->children[n], key, level + 1, std::move(value));
+        //Drop nodes that became empty, so a map with everything removed is the empty map again.
+        for(auto& child : copy->children)
+        {
+            if (child)
+                return copy;
+        }
+        return nullptr;
+    }
+
+    template<typename F> static void forEach(const NodePtr& node, int level, F& f)
+    {
+        if (!node)
+            return;
+        if (level == depth)
+        {
+            f(*node->value);
+            return;
+        }
+        for(auto& child : node->children)
+            forEach(child, level + 1, f);
+    }
+
+    template<typename F> static void forEachDifference(const NodePtr& a, const NodePtr& b, int level, F& f)
+    {
+        if (a == b)
+            return;
+        if (level == depth)
+        {
+            f(a ? a->value.get() : nullptr, b ? b->value.get() : nullptr);
+            return;
+        }
+        for(int n=0; n<slot_count; n++)
+            forEachDifference(a ? a->children[n] : nullptr, b ? b->children[n] : nullptr, level + 1, f);
+    }
+
+    NodePtr root;
+};
+
+//A room as stored in a DungeonSnapshot. Rooms are on a grid of 4 by 6 world units.
+struct RoomState
+{
+    int x;
+    int y;
+    bool build;
+    bool entrance;
+    //Build action that placed the object in this room, empty when there is none.
+    sp::string object;
+    int object_value;
+    int object_state;
+
+    bool operator==(const RoomState& other) const
+    {
+        return x == other.x && y == other.y && build == other.build && entrance == other.entrance
+            && object == other.object && object_value == other.object_value && object_state == other.object_state;
+    }
+
+    bool operator!=(const RoomState& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+struct EconomyState
+{
+    int money;
+    float risk;
+    float reward;
+    float dragon_deception;
+    int placable_bodies;
+
+    bool operator==(const EconomyState& other) const
+    {
+        return money == other.money && risk == other.risk && reward == other.reward
+            && dragon_deception == other.dragon_deception && placable_bodies == other.placable_bodies;
+    }
+};
+
+//The build state of a dungeon between days: its rooms, the objects in them and the economy.
+//A snapshot is a value. Copying one is O(1) and changes to a copy never show up in the original,
+//so keeping an undo point or starting a what-if branch is just taking a copy.
+class DungeonSnapshot
+{
+public:
+    static uint32_t roomKey(int x, int y)
+    {
+        return (uint32_t(uint16_t(x)) << 16) | uint16_t(y);
+    }
+
+    static int gridX(sp::Vector2d position)
+    {
+        return int(std::floor(position.x / 4.0 + 0.5));
+    }
+
+    static int gridY(sp::Vector2d position)
+    {
+        return int(std::floor(position.y / 6.0 + 0.5));
+    }
+
+    static sp::Vector2d worldPosition(int x, int y)
+    {
+        return sp::Vector2d(x * 4, y * 6);
+    }
+
+    const RoomState* getRoom(int x, int y) const
+    {
+        return rooms.find(roomKey(x, y));
+    }
+
+    //Same rooms and economy, compared by value. Snapshots that were made separately share nothing, but can still be equal.
+    bool equals(const DungeonSnapshot& other) const
+    {
+        bool equal = economy && other.economy ? *economy == *other.economy : !economy && !other.economy;
+        rooms.forEachDifference(other.rooms, [&equal](const RoomState* a, const RoomState* b)
+        {
+            if (!a || !b || *a != *b)
+                equal = false;
+        });
+        return equal;
+    }
+
+    PersistentMap<RoomState> rooms;
+    //Empty in a default constructed snapshot.
+    std::shared_ptr<const EconomyState> economy;
+};
@@ -0,0 +1,279 @@
+//Everything the dungeon GUI shows. Filled in by whoever owns the simulation, so the GUI never touches game objects directly.
+struct DungeonUIModel
+{
+    int money = 0;
+    int placable_bodies = 0;
+    bool day_running = false;
+
+    bool has_selection = false;
+    sp::Vector2d selection_position;
+    bool selection_build = false;
+    bool selection_has_object = false;
+    int selection_object_value = 0;
+    bool can_undo = false;
+
+    //Number of finished days, the results of the last one are shown when this changes.
+    int day = 0;
+    float tribute = 0.0f;
+    std::vector<DayResultLine> day_results;
+};
+
+//Requests made from the dungeon GUI.
+class DungeonCommands
+{
+public:
+    virtual ~DungeonCommands() {}
+
+    virtual void selectRoom(sp::Vector2d position) = 0;
+    virtual void startDay() = 0;
+    virtual void buildAction(const sp::string& action) = 0;
+    virtual void undo() = 0;
+};
+
+//The GUI of a dungeon and the room selection indicator. Only reads a DungeonUIModel, and sends everything the player does to DungeonCommands.
+class DungeonUI
+{
+public:
+    DungeonUI(sp::P<sp::Scene> scene, DungeonCommands& commands, const std::unordered_map<sp::string, int>& cost_map)
+    : cost_map(cost_map)
+    {
+        ui = getLoader().create("MAIN");
+
+        build_panel.bind(ui, "BUILD_PANEL");
+        info_panel.bind(ui, "INFO_PANEL");
+        info_label.bind(ui, "INFO_LABEL");
+        play_button.bind(ui, "PLAY_BUTTON");
+        build_button.bind(ui, "BUILD_BUTTON");
+        undo_button.bind(ui, "UNDO_BUTTON");
+        dig.bind(ui, "DIG");
+        pit.bind(ui, "PIT");
+        loot.bind(ui, "LOOT");
+        fire.bind(ui, "FIRE");
+        slime.bind(ui, "SLIME");
+        body.bind(ui, "BODY");
+        sell.bind(ui, "SELL");
+        result_panel.bind(ui, "RESULT_PANEL");
+        result_rows.bind(ui, "RESULT_ROWS");
+        result_tribute.bind(ui, "TRIBUTE");
+        result_done_button.bind(ui, "RESULT_DONE_BUTTON");
+        allocation_info.bind(ui, "ALLOCATION_INFO");
+
+        selection_indicator = new sp::Node(scene->getRoot());
+        selection_indicator->render_data.type = sp::RenderData::Type::None;
+        selection_indicator->render_data.shader = sp::Shader::get("internal:color.shader");
+        selection_indicator->render_data.mesh = sp::MeshData::createQuad(sp::Vector2f(4, 6));
+        selection_indicator->render_data.color = sp::Color(0.15, 0.15, 0.15);
+        selection_indicator->render_data.order = -1;
+
+        play_button.get()->setEventCallback([&commands](sp::Variant v)
+        {
+            commands.startDay();
+        });
+        for(auto button : {std::make_pair(&dig, "DIG"), std::make_pair(&pit, "PIT"), std::make_pair(&loot, "LOOT"), std::make_pair(&fire, "FIRE"),
+            std::make_pair(&slime, "SLIME"), std::make_pair(&body, "BODY"), std::make_pair(&sell, "SELL")})
+        {
+            sp::string button_action = button.second;
+            button.first->get()->setEventCallback([this, button_action](sp::Variant v)
+            {
+                action = button_action;
+                markDirty();
+            });
+        }
+        build_button.get()->setEventCallback([this, &commands](sp::Variant v)
+        {
+            commands.buildAction(action);
+            clearAction();
+        });
+        undo_button.get()->setEventCallback([this, &commands](sp::Variant v)
+        {
+            commands.undo();
+            clearAction();
+        });
+        result_done_button.get()->setEventCallback([this](sp::Variant v)
+        {
+            result_panel.hide();
+            markDirty();
+        });
+    }
+
+    ~DungeonUI()
+    {
+        ui.destroy();
+        selection_indicator.destroy();
+    }
+
+    //Request a refresh, the actual widget changes are applied once per frame in update().
+    void markDirty()
+    {
+        dirty = true;
+    }
+
+    bool isDirty()
+    {
+        return dirty;
+    }
+
+    void clearAction()
+    {
+        action = "";
+        markDirty();
+    }
+
+    void update(float delta, const DungeonUIModel& model)
+    {
+        if (dirty)
+        {
+            dirty = false;
+            refresh(model);
+        }
+#ifdef DEBUG
+        allocation_info_delay -= delta;
+        if (allocation_info_delay <= 0.0f)
+        {
+            allocation_info_delay = 1.0f;
+            allocation_info.show();
+            allocation_info.setCaption(sp::string("\n").join(AllocationTracker::get().getReport()));
+            allocation_info.apply();
+        }
+#endif
+    }
+
+private:
+    //main.gui is parsed once for the whole process, every DungeonUI and result line is created from the parsed tree.
+    static sp::gui::Loader& getLoader()
+    {
+        static sp::gui::Loader loader("gui/main.gui");
+        return loader;
+    }
+
+    void refresh(const DungeonUIModel& model)
+    {
+        if (shown_day < 0)
+            shown_day = model.day;
+        else if (shown_day != model.day)
+            showResults(model);
+
+        if (model.day_running)
+        {
+            selection_indicator->render_data.type = sp::RenderData::Type::None;
+            build_panel.hide();
+            info_panel.hide();
+        }
+        else if (model.has_selection)
+        {
+            selection_indicator->setPosition(model.selection_position);
+            selection_indicator->render_data.type = sp::RenderData::Type::Normal;
+            info_panel.show();
+            build_panel.show();
+            dig.setVisible(!model.selection_build);
+            pit.setVisible(model.selection_build && !model.selection_has_object);
+            loot.setVisible(model.selection_build && !model.selection_has_object);
+            fire.setVisible(model.selection_build && !model.selection_has_object);
+            slime.setVisible(model.selection_build && !model.selection_has_object);
+            body.setVisible(model.selection_build && !model.selection_has_object && model.placable_bodies > 0);
+            sell.setVisible(model.selection_build && model.selection_has_object && model.selection_object_value > 0);
+
+            build_button.setVisible(action != "");
+            build_button.setCaption(action != "SELL" ? "[BUILD]" : "[SELL]");
+        }
+        else
+        {
+            selection_indicator->render_data.type = sp::RenderData::Type::None;
+            info_panel.show();
+            build_panel.hide();
+            build_button.hide();
+        }
+
+        undo_button.setVisible(!model.day_running && model.can_undo);
+
+        sp::string info = "Money: " + sp::string(model.money);
+        if (action == "DIG")
+            info += "\nDig a new room.\nExpand your dungeon.";
+        else if (action == "PIT")
+            info += "\nBuild a spike pit\nSimple device,\nbut effective.";
+        else if (action == "LOOT")
+            info += "\nPlace a pile of gold\nto find.\nIf someone escapes\nwith this.\nIt will bring\nMore and better\nadventurers.";
+        else if (action == "FIRE")
+            info += "\nFire trap, burns\nadventurers.\nAdds a lot of\ndeception\non a kill.";
+        else if (action == "SLIME")
+            info += "\nSlime trap.\nMade with powered\ninsta-slime.\nIncreases damage\nand fear from other\ntraps.";
+        else if (action == "BODY")
+            info += "\nPlace a dead body.\nDecays after a\nfew days.\nAdds fear.\nAmount:" + sp::string(model.placable_bodies);
+        else if (action == "SELL")
+            info += "\nSell back for: $" + sp::string(model.selection_object_value);
+        auto cost = cost_map.find(action);
+        if (cost != cost_map.end())
+        {
+            info += "\nCost: $" + sp::string(cost->second);
+        }
+        info_label.setCaption(info);
+
+        build_panel.apply();
+        info_panel.apply();
+        info_label.apply();
+        build_button.apply();
+        undo_button.apply();
+        dig.apply();
+        pit.apply();
+        loot.apply();
+        fire.apply();
+        slime.apply();
+        body.apply();
+        sell.apply();
+        result_panel.apply();
+        result_tribute.apply();
+    }
+
+    void showResults(const DungeonUIModel& model)
+    {
+        shown_day = model.day;
+        result_panel.show();
+        while (!result_rows.get()->getChildren().empty())
+            (*result_rows.get()->getChildren().begin()).destroy();
+        for(auto& line : model.day_results)
+        {
+            sp::P<sp::gui::Widget> row = getLoader().create("RESULT_LINE", result_rows.get());
+            switch(line.result)
+            {
+            case AdventurerResult::Death:
+                row->getWidgetWithID("RESULT")->setAttribute("caption", "Death");
+                break;
+            case AdventurerResult::Escaped:
+                row->getWidgetWithID("RESULT")->setAttribute("caption", "Escaped");
+                break;
+            case AdventurerResult::Fled:
+                row->getWidgetWithID("RESULT")->setAttribute("caption", "Fled");
+                break;
+            }
+            row->getWidgetWithID("INFO")->setAttribute("caption", line.info);
+        }
+        result_tribute.setCaption("Tribute from villages: $" + sp::string(int(model.tribute)));
+    }
+
+    std::unordered_map<sp::string, int> cost_map;
+    sp::string action;
+    bool dirty = true;
+    int shown_day = -1;
+
+    sp::P<sp::gui::Widget> ui;
+    sp::P<sp::Node> selection_indicator;
+    WidgetBinding build_panel;
+    WidgetBinding info_panel;
+    WidgetBinding info_label;
+    WidgetBinding play_button;
+    WidgetBinding build_button;
+    WidgetBinding undo_button;
+    WidgetBinding dig;
+    WidgetBinding pit;
+    WidgetBinding loot;
+    WidgetBinding fire;
+    WidgetBinding slime;
+    WidgetBinding body;
+    WidgetBinding sell;
+    WidgetBinding result_panel;
+    WidgetBinding result_rows;
+    WidgetBinding result_tribute;
+    WidgetBinding result_done_button;
+    WidgetBinding allocation_info;
+    float allocation_info_delay = 0.0f;
+};
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <atomic>
+
+//Global budget for purely cosmetic effects. Tracks the recent frame interval, the cost of the frame update and the fixed update cost,
+//and scales effect counts, lifetimes and update rates down while we are over budget, and back up when there is headroom.
+//Effects only use the cosmetic random generator of the session, so the budget never changes gameplay.
+class EffectBudget
+{
+public:
+    //Refresh interval assumed until frames were measured.
+    static constexpr float target_frame_time = 1.0f / 60.0f;
+    static constexpr float target_tick_time = 1.0f / 60.0f * 0.25f;
+    static constexpr float min_scale = 0.1f;
+
+    //delta is the interval since the last frame, work_seconds what the frame update itself took.
+    void addFrame(float delta, float work_seconds)
+    {
+        average_frame_time += (delta - average_frame_time) * 0.1f;
+        average_work_time += (work_seconds - average_work_time) * 0.1f;
+        //The display refresh interval, the target for the frame interval. It starts as the shortest interval of the first frames,
+        //then follows shorter intervals quickly, and longer ones slowly and only while the update is cheap, so a vsync below 60Hz
+        //is not over budget, while frames that are slow because of us are.
+        if (measured_frames < refresh_measure_frames)
+        {
+            refresh_interval = measured_frames == 0 ? delta : std::min(refresh_interval, delta);
+            measured_frames++;
+        }
+        else if (delta < refresh_interval)
+        {
+            refresh_interval += (delta - refresh_interval) * 0.1f;
+        }
+        else if (work_seconds < delta * 0.25f)
+        {
+            refresh_interval += (delta - refresh_interval) * 0.01f;
+        }
+        refresh_interval = std::max(min_refresh_interval, refresh_interval);
+        update();
+    }
+
+    //Can be called from a simulation thread, while addFrame() runs on the main thread.
+    void addTick(float seconds)
+    {
+        float average = average_tick_time;
+        average_tick_time = average + (seconds - average) * 0.1f;
+    }
+
+    //Scale for the amount and lifetime of effects, between min_scale and 1.
+    float getScale()
+    {
+        return scale;
+    }
+
+    //Number of effects to spawn for something that would spawn count of them on an idle machine, never more than hard_cap.
+    int scaleCount(int count, int hard_cap)
+    {
+        return std::min(hard_cap, std::max(1, int(count * scale + 0.5f)));
+    }
+
+    //Effects only refresh their visuals every this many frames.
+    int getUpdateInterval()
+    {
+        return update_interval;
+    }
+
+private:
+    void update()
+    {
+        //Frames that come slower than the display refreshes, or an update that takes half a refresh, are over budget.
+        bool refresh_known = measured_frames >= refresh_measure_frames;
+        bool over = (refresh_known && average_frame_time > refresh_interval * 1.25f) || average_work_time > refresh_interval * 0.5f || average_tick_time > target_tick_time;
+        bool headroom = average_frame_time < refresh_interval * 1.1f && average_work_time < refresh_interval * 0.25f && average_tick_time < target_tick_time * 0.5f;
+        float new_scale = scale;
+        if (over)
+            new_scale = std::max(min_scale, new_scale * 0.95f);
+        else if (headroom)
+            new_scale = std::min(1.0f, new_scale * 1.02f);
+        scale = new_scale;
+        update_interval = new_scale > 0.75f ? 1 : new_scale > 0.4f ? 2 : 4;
+    }
+
+    static constexpr float min_refresh_interval = 1.0f / 240.0f;
+    static constexpr int refresh_measure_frames = 60;
+
+    float average_frame_time = target_frame_time;
+    float average_work_time = 0.0f;
+    float refresh_interval = target_frame_time;
+    int measured_frames = 0;
+    std::atomic<float> average_tick_time{0.0f};
+    std::atomic<float> scale{1.0f};
+    std::atomic<int> update_interval{1};
+};
+
+EffectBudget effect_budget;
@@ -8,20 +8,28 @@ public:
     {
         buildString(render_data, "\\|/");
         setPosition(sp::Vector2d(0, 1.2));
+        getSession(this).timers.schedule(lifetime + 1, this, [this]() { delete this; });
     }
 
-    virtual void onFixedUpdate() override
+    //Effects on the same adventurer are drawn on top of each other, so never show more than one.
+    static void spawn(sp::P<sp::Node> parent)
     {
-        if (lifetime)
-            lifetime--;
-        else
-            delete this;
+        for(sp::P<ScaredEffect> effect : parent->getChildren())
+        {
+            if (effect)
+                return;
+        }
+        new ScaredEffect(parent);
     }
 
 private:
-    int lifetime = 30;
+    static constexpr int lifetime = 30;
+
+    AllocationTag<ScaredEffect> allocation_tag{"ScaredEffect"};
 };
 
+//Fire particles are moved by the MoverSystem of the session, only while they are visible.
+//The color is calculated from the age of the particle when it is rendered.
 class FireEffect : public sp::Node
 {
 public:
@@ -29,25 +37,36 @@ public:
     : sp::Node(parent)
     {
         buildString(render_data, "*");
-        max_lifetime = sp::irandom(50, 150);
-        lifetime = max_lifetime;
-        velocity = sp::Vector2d(sp::random(0.1, 1.0), 0).rotate(sp::random(0, 360));
+        GameSession& session = getSession(this);
+        max_lifetime = std::max(10, int(session.effectIRandom(50, 150) * effect_budget.getScale()));
+        update_frame = session.effectIRandom(0, 3);
+        sp::Vector2d velocity = sp::Vector2d(session.effectRandom(0.1, 1.0), 0).rotate(session.effectRandom(0, 360));
+        start_tick = session.timers.getTick();
+        //The alpha reaches zero halfway through the lifetime, after that there is nothing to move.
+        session.movers.setDamped(mover, this, sp::Vector2d(0, 0), velocity, start_tick, start_tick + max_lifetime / 2 + 1);
+        session.timers.schedule(max_lifetime + 1, this, [this]() { delete this; });
     }
 
-    virtual void onFixedUpdate() override
+    virtual void onUpdate(float delta) override
     {
+        //The first update always runs, before it the particle has no color yet.
+        if (updated && ++update_frame % effect_budget.getUpdateInterval())
+            return;
+        updated = true;
+        int age = std::min<uint64_t>(getSession(this).timers.getTick() - start_tick, max_lifetime + 1);
+        if (age > max_lifetime / 2 + 1)
+            return;
+        int lifetime = std::max(0, max_lifetime - age + 1);
         render_data.color = sp::Tween<sp::Color>::easeOutCubic(lifetime, max_lifetime, 0, sp::HsvColor(0, 100, 100), sp::HsvColor(30, 100, 100));
         render_data.color.a = sp::Tween<float>::easeOutCubic(lifetime, max_lifetime, max_lifetime / 2, 1.0f, 0.0f);
-        setPosition(getPosition2D() + velocity * 0.1);
-        velocity *= 0.99;
-        if (lifetime)
-            lifetime--;
-        else
-            delete this;
     }
 
 private:
-    int lifetime;
     int max_lifetime;
-    sp::Vector2d velocity;
+    int update_frame;
+    bool updated = false;
+    uint64_t start_tick;
+    Mover mover;
+
+    AllocationTag<FireEffect> allocation_tag{"FireEffect"};
 };
\ No newline at end of file
@@ -11,32 +11,35 @@
 #include <sp2/graphics/scene/basicnoderenderpass.h>
 #include <sp2/graphics/scene/collisionrenderpass.h>
 #include <sp2/graphics/textureManager.h>
+#ifdef BAKED_GLYPHS
+#include <sp2/graphics/textureAtlas.h>
+#endif
 #include <sp2/scene/scene.h>
 #include <sp2/scene/node.h>
 #include <sp2/scene/camera.h>
 #include <sp2/io/keybinding.h>
 
 #include <unordered_set>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <limits>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#include "timerWheel.h"
+#include "allocationTracker.h"
+#include "effectBudget.h"
+#include "movers.h"
+#include "worldText.h"
 
 sp::P<sp::Window> window;
-sp::P<sp::gui::Widget> main_ui;
 
 sp::io::Keybinding escape_key{"exit", "Escape"};
 sp::Font* main_font;
 
-int money = 30;
-float risk = 0.0;
-float reward = 0.0;
-float dragon_deception = 0.0;
-int placable_bodies = 0;
-
-std::unordered_map<sp::string, int> cost_map{
-    {"DIG", 10},
-    {"PIT", 30},
-    {"LOOT", 100},
-    {"FIRE", 300},
-    {"SLIME", 200},
-};
 struct AdventurerResult
 {
     enum Result
@@ -52,22 +55,109 @@ struct AdventurerResult
     float deception;
 };
 
-std::vector<AdventurerResult> adventurer_results;
+//Outcome of a single adventurer, as shown on the end of day report.
+struct DayResultLine
+{
+    AdventurerResult::Result result;
+    sp::string info;
+};
 
-void buildString(sp::RenderData& render_data, const sp::string& str)
+//All game state of a single dungeon. Every DungeonScene owns one, nodes find it through their scene with getSession().
+class GameSession
 {
-    static std::unordered_map<sp::string, std::shared_ptr<sp::MeshData>> cache;
+public:
+    GameSession(uint32_t seed)
+    : seed(seed), random_engine(seed), effect_random_engine(seed ^ 0x9e3779b9)
+    {
+    }
 
-    render_data.type = sp::RenderData::Type::Normal;
-    render_data.shader = sp::Shader::get("internal:basic.shader");
-    auto it = cache.find(str);
-    if (it != cache.end())
+    //Gameplay randomness, per session so a session can be reproduced from its seed.
+    int irandom(int min, int max)
     {
-        render_data.mesh = it->second;
+        return std::uniform_int_distribution<int>(min, max)(random_engine);
     }
-    else
+
+    //Randomness for cosmetic effects. Kept apart so effects can never change gameplay results.
+    float effectRandom(float min, float max)
     {
-        auto info = main_font->prepare(str, 32, 1.0, sp::Vector2d(0, 0), sp::Alignment::TopLeft);
+        return std::uniform_real_distribution<float>(min, max)(effect_random_engine);
+    }
+
+    int effectIRandom(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(effect_random_engine);
+    }
+
+    uint32_t seed;
+    bool headless = false;
+
+    int money = 30;
+    float risk = 0.0;
+    float reward = 0.0;
+    float dragon_deception = 0.0;
+    int placable_bodies = 0;
+
+    std::unordered_map<sp::string, int> cost_map{
+        {"DIG", 10},
+        {"PIT", 30},
+        {"LOOT", 100},
+        {"FIRE", 300},
+        {"SLIME", 200},
+    };
+    //Spawn parameters. The defaults are the normal game, a forced value of 0 means it follows from risk and reward.
+    int forced_spawn_count = 0;
+    int forced_max_level = 0;
+    int spawn_delay_min = 80;
+    int spawn_delay_max = 140;
+
+    std::vector<AdventurerResult> adventurer_results;
+    std::vector<DayResultLine> last_day_results;
+    uint32_t next_adventurer_id = 1;
+
+    TimerWheel timers;
+    MoverSystem movers;
+
+    int day = 0;
+    int deaths = 0;
+    int fled = 0;
+    int escaped = 0;
+
+private:
+    std::mt19937 random_engine;
+    std::mt19937 effect_random_engine;
+};
+
+GameSession& getSession(sp::P<sp::Node> node);
+
+//Estimated size of the mesh of a single character: 4 vertices of position, normal and uv, plus 6 indices.
+static constexpr int mesh_bytes_per_glyph = 4 * 8 * sizeof(float) + 6 * sizeof(uint16_t);
+
+//The thread that owns the world text. Set by prepareWorldText().
+std::thread::id graphics_thread_id;
+//Headless sessions never prepare the world text and have nothing to draw.
+bool world_text_ready = false;
+
+struct CachedString
+{
+    std::shared_ptr<sp::MeshData> mesh;
+    sp::Texture* texture;
+};
+static std::unordered_map<sp::string, CachedString> string_cache;
+
+void buildString(sp::RenderData& render_data, const sp::string& str)
+{
+    if (!world_text_ready)
+        return;
+
+    //Only the graphics thread can add to the cache, a simulation thread can only use what prepareWorldText() prepared.
+    bool graphics_thread = std::this_thread::get_id() == graphics_thread_id;
+    auto it = string_cache.find(str);
+    if (it == string_cache.end())
+    {
+        //Strings that are not baked are made from the font, which is only loaded without baked glyphs.
+        if (!graphics_thread || !main_font)
+            return;
+        auto info = main_font->prepare(str, world_text_pixel_size, 1.0, sp::Vector2d(0, 0), sp::Alignment::TopLeft);
         sp::Vector2f offset = info.getUsedAreaSize() * 0.5f;
         for(auto& i : info.data)
         {
@@ -75,10 +165,68 @@ void buildString(sp::RenderData& render_data, const sp::string& str)
             i.position.y += offset.y;
             i.position.y *= 0.8;
         }
-        render_data.mesh = info.create();
-        cache[str] = render_data.mesh;
+        it = string_cache.emplace(str, CachedString{info.create(), main_font->getTexture(world_text_pixel_size)}).first;
+        AllocationTracker::get().getCounter("MeshCache").add(info.data.size() * mesh_bytes_per_glyph);
+    }
+    static sp::Shader* shader = sp::Shader::get("internal:basic.shader");
+    render_data.type = sp::RenderData::Type::Normal;
+    render_data.shader = shader;
+    render_data.mesh = it->second.mesh;
+    render_data.texture = graphics_thread && main_font ? main_font->getTexture(world_text_pixel_size) : it->second.texture;
+}
+
+#ifdef BAKED_GLYPHS
+#include "bakedGlyphs.h"
+
+//Make the meshes of all strings from the tables that tools/bakeGlyphs.cpp generated at build time, on a texture of the baked atlas.
+void loadBakedStrings()
+{
+    std::vector<uint32_t> pixels(baked_glyph_atlas_width * baked_glyph_atlas_height);
+    for(size_t n=0; n<pixels.size(); n++)
+        pixels[n] = 0x00ffffff | (uint32_t(baked_glyph_atlas[n]) << 24);
+    sp::AtlasTexture* texture = new sp::AtlasTexture("baked_glyphs", sp::Vector2i(baked_glyph_atlas_width, baked_glyph_atlas_height));
+    sp::Rect2f area = texture->add(sp::Image(sp::Vector2i(baked_glyph_atlas_width, baked_glyph_atlas_height), std::move(pixels)));
+
+    AllocationCounter& cache_counter = AllocationTracker::get().getCounter("MeshCache");
+    for(const BakedString& baked : baked_strings)
+    {
+        sp::MeshData::Vertices vertices;
+        sp::MeshData::Indices indices;
+        for(int n=0; n<baked.quad_count * 4; n++)
+        {
+            const BakedGlyphVertex& v = baked.vertices[n];
+            vertices.emplace_back(sp::Vector3f(v.x, v.y, 0.0f), sp::Vector2f(area.position.x + v.u * area.size.x, area.position.y + v.v * area.size.y));
+        }
+        for(int n=0; n<baked.quad_count; n++)
+        {
+            for(int index : {0, 1, 2, 2, 1, 3})
+                indices.push_back(n * 4 + index);
+        }
+        string_cache.emplace(baked.text, CachedString{sp::MeshData::create(std::move(vertices), std::move(indices)), texture});
+        cache_counter.add(baked.quad_count * mesh_bytes_per_glyph);
+    }
+}
+#endif
+
+//The world only uses the fixed set of strings of worldText.h. Make all their meshes while loading, so no frame has to.
+//With baked glyphs they come from tables generated at build time and the font is never loaded, without them the font
+//is loaded and rasterized here. After this the cache is only read, which makes it safe to use from the simulation thread.
+void prepareWorldText()
+{
+    graphics_thread_id = std::this_thread::get_id();
+#ifdef BAKED_GLYPHS
+    loadBakedStrings();
+#else
+    main_font = sp::font_manager.get(world_text_font);
+#endif
+    world_text_ready = true;
+    sp::RenderData render_data;
+    for(auto& str : getWorldStrings())
+    {
+        buildString(render_data, str);
+        if (string_cache.find(str) == string_cache.end())
+            LOG(Warning, "No mesh for world string", str);
     }
-    render_data.texture = main_font->getTexture(32);
 }
 
 class DungeonRoom;
@@ -93,10 +241,16 @@ public:
     virtual void onCenterRoom(sp::P<Adventurer> adventurer) {}
     virtual void onEndOfDay() {}
 
+    //Build action that places this object, and its state. Used to store it in a DungeonSnapshot and by the StateExporter.
+    //Only the state between days has to survive a setState(getState()).
+    virtual const char* getAction() { return ""; }
+    virtual int getState() { return 0; }
+    virtual void setState(int state) {}
+
     int value = 0;
 };
 
-sp::P<DungeonRoom> getRoomAt(sp::Vector2d position, bool allow_unbuild=false);
+sp::P<DungeonRoom> getRoomAt(sp::P<sp::Scene> scene, sp::Vector2d position, bool allow_unbuild=false);
 class DungeonRoom : public sp::Node
 {
 public:
@@ -108,10 +262,10 @@ public:
 
     void updateGraphics()
     {
-        bool up = build && getRoomAt(getPosition2D() + sp::Vector2d(0, 6)) != nullptr;
-        bool down = build && getRoomAt(getPosition2D() + sp::Vector2d(0, -6)) != nullptr;
-        bool left = build && getRoomAt(getPosition2D() + sp::Vector2d(-4, 0)) != nullptr;
-        bool right = build && getRoomAt(getPosition2D() + sp::Vector2d(4, 0)) != nullptr;
+        bool up = build && getRoomAt(getScene(), getPosition2D() + sp::Vector2d(0, 6)) != nullptr;
+        bool down = build && getRoomAt(getScene(), getPosition2D() + sp::Vector2d(0, -6)) != nullptr;
+        bool left = build && getRoomAt(getScene(), getPosition2D() + sp::Vector2d(-4, 0)) != nullptr;
+        bool right = build && getRoomAt(getScene(), getPosition2D() + sp::Vector2d(4, 0)) != nullptr;
 
         if (entrance)
             left = true;
@@ -121,24 +275,7 @@ public:
         else
             render_data.color = sp::Color(0.4, 0.4, 0.4);
 
-        sp::string result;
-        if (up)
-            result += "  | |  \n +- -+ \n";
-        else
-            result += "       \n +---+ \n";
-        if (left && right)
-            result += "-|   |-\n       \n-|   |-\n";
-        else if (left)
-            result += "-|   | \n     | \n-|   | \n";
-        else if (right)
-            result += " |   |-\n |     \n |   |-\n";
-        else
-            result += " |   | \n |   | \n |   | \n";
-        if (down)
-            result += " +- -+ \n  | |  ";
-        else
-            result += " +---+ \n       ";
-        buildString(render_data, result);
+        buildString(render_data, buildRoomString(up, down, left, right));
     }
 
     void doBuild()
@@ -147,22 +284,22 @@ public:
             return;
         build = true;
         updateGraphics();
-        sp::P<DungeonRoom> r = getRoomAt(getPosition2D() + sp::Vector2d(0, 6), true);
+        sp::P<DungeonRoom> r = getRoomAt(getScene(), getPosition2D() + sp::Vector2d(0, 6), true);
         if (r)
             r->updateGraphics();
         else
             (new DungeonRoom(getParent()))->setPosition(getPosition2D() + sp::Vector2d(0, 6));
-        r = getRoomAt(getPosition2D() + sp::Vector2d(0, -6), true);
+        r = getRoomAt(getScene(), getPosition2D() + sp::Vector2d(0, -6), true);
         if (r)
             r->updateGraphics();
         else
             (new DungeonRoom(getParent()))->setPosition(getPosition2D() + sp::Vector2d(0, -6));
-        r = getRoomAt(getPosition2D() + sp::Vector2d(-4, 0), true);
+        r = getRoomAt(getScene(), getPosition2D() + sp::Vector2d(-4, 0), true);
         if (r)
             r->updateGraphics();
         else if (getPosition2D().x > 1.0)
             (new DungeonRoom(getParent()))->setPosition(getPosition2D() + sp::Vector2d(-4, 0));
-        r = getRoomAt(getPosition2D() + sp::Vector2d(4, 0), true);
+        r = getRoomAt(getScene(), getPosition2D() + sp::Vector2d(4, 0), true);
         if (r)
             r->updateGraphics();
         else
@@ -172,11 +309,13 @@ public:
     bool build = false;
     bool entrance = false;
     sp::P<DungeonObject> main_object;
+private:
+    AllocationTag<DungeonRoom> allocation_tag{"DungeonRoom"};
 };
 
-sp::P<DungeonRoom> getRoomAt(sp::Vector2d position, bool allow_unbuild)
+sp::P<DungeonRoom> getRoomAt(sp::P<sp::Scene> scene, sp::Vector2d position, bool allow_unbuild)
 {
-    for(sp::P<DungeonRoom> room : sp::Scene::get("DUNGEON")->getRoot()->getChildren())
+    for(sp::P<DungeonRoom> room : scene->getRoot()->getChildren())
     {
         if (!room || (!room->build && !allow_unbuild))
             continue;
@@ -188,159 +327,232 @@ sp::P<DungeonRoom> getRoomAt(sp::Vector2d position, bool allow_unbuild)
     return nullptr;
 }
 
+//Adventurers do not move every tick. Whenever their target changes, the ticks at which they enter
+//and reach the center of the target room are calculated from their speed, and scheduled on the session timers.
+//The position in between is only calculated for rendering, by the MoverSystem of the session.
 class Adventurer : public sp::Node
 {
 public:
     Adventurer(sp::P<sp::Node> parent, int level)
-    : sp::Node(parent), level(level)
+    : sp::Node(parent), level(level), id(getSession(parent).next_adventurer_id++)
     {
         buildString(render_data, "@");
         render_data.scale = sp::Vector3f(1.3, 1.3, 1.3);
         render_data.color = sp::HsvColor(90, 70, 100);
         render_data.order = 5;
 
-        setPosition(sp::Vector2d(-4, 0));
-        current_room = getRoomAt(sp::Vector2d(0, 0));
+        segment_start = sp::Vector2d(-4, 0);
+        setPosition(segment_start);
+        current_room = getRoomAt(getScene(), sp::Vector2d(0, 0));
         hp = level;
         courage = level + 1;
+        planMovement();
     }
 
-    virtual void onFixedUpdate() override
+    sp::Vector2d getLogicalPosition()
     {
-        if (current_room && (current_room->getPosition2D() - getPosition2D()).length() < 0.1)
+        uint64_t steps = std::min(getSession(this).timers.getTick() - segment_tick, segment_steps);
+        return segment_start + segment_direction * (segment_speed * steps);
+    }
+
+    bool takeDamage(int amount)
+    {
+        hp -= amount;
+        if (slimed)
+            hp -= amount;
+        if (hp > 0)
+            return false;
+        return true;
+    }
+
+    void addSlime()
+    {
+        slimed = true;
+        render_data.color = sp::HsvColor(120, 70, 100);
+    }
+
+    bool addFear(int amount)
+    {
+        courage -= amount;
+        if (slimed)
+            courage -= amount;
+        if (courage <= 0)
+            fleeing = true;
+        return fleeing;
+    }
+
+    int getHp()
+    {
+        return hp;
+    }
+
+    int getCourage()
+    {
+        return courage;
+    }
+
+    bool isFleeing()
+    {
+        return fleeing;
+    }
+
+    bool isSlimed()
+    {
+        return slimed;
+    }
+
+    int loot = 0;
+    int level;
+    const uint32_t id;
+private:
+    //Start a new straight movement segment from the current position, and schedule the events along it.
+    void planMovement()
+    {
+        TimerWheel& timers = getSession(this).timers;
+        segment_start = getLogicalPosition();
+        segment_tick = timers.getTick();
+        setPosition(segment_start);
+        int generation = ++movement_generation;
+
+        if (current_room)
         {
-            if (visited_rooms.find(*current_room) == visited_rooms.end())
+            segment_speed = fleeing ? 0.12 : 0.08;
+            sp::Vector2d diff = current_room->getPosition2D() - segment_start;
+            double distance = diff.length();
+            segment_direction = distance > 0.0 ? diff.normalized() : sp::Vector2d(0, 0);
+            //Steps until we are within 0.1 of the center, the arrival is handled on the tick after that.
+            segment_steps = distance < 0.1 ? 0 : uint64_t((distance - 0.1) / segment_speed) + 1;
+            if (!in_room && distance >= 0.1)
             {
-                for(sp::P<DungeonObject> obj : current_room->getChildren())
+                uint64_t enter_steps = distance < 1.0 ? 1 : uint64_t((distance - 1.0) / segment_speed) + 1;
+                timers.schedule(enter_steps, this, [this, generation]()
                 {
-                    if (obj)
-                        obj->onCenterRoom(this);
-                }
-                visited_rooms.insert(*current_room);
+                    if (generation == movement_generation)
+                        onEnterRoom();
+                });
             }
+            timers.schedule(segment_steps + 1, this, [this, generation]()
+            {
+                if (generation == movement_generation)
+                    onArriveAtCenter();
+            });
+        }
+        else
+        {
+            segment_speed = 0.1;
+            segment_direction = sp::Vector2d(-1, 0);
+            segment_steps = segment_start.x < -4.0 ? 1 : uint64_t((segment_start.x + 4.0) / segment_speed) + 1;
+            timers.schedule(segment_steps, this, [this, generation]()
+            {
+                if (generation == movement_generation)
+                    onLeaveDungeon();
+            });
+        }
+        getSession(this).movers.setLinear(mover, this, segment_start, segment_direction * segment_speed, segment_tick, segment_steps);
+    }
 
-            sp::PList<DungeonRoom> options;
-            sp::P<DungeonRoom> r;
-            r = getRoomAt(getPosition2D() + sp::Vector2d(4, 0));
-            if (r && visited_rooms.find(*r) == visited_rooms.end())
-                options.add(r);
-            r = getRoomAt(getPosition2D() + sp::Vector2d(-4, 0));
-            if (r && visited_rooms.find(*r) == visited_rooms.end())
-                options.add(r);
-            r = getRoomAt(getPosition2D() + sp::Vector2d(0, 6));
-            if (r && visited_rooms.find(*r) == visited_rooms.end())
-                options.add(r);
-            r = getRoomAt(getPosition2D() + sp::Vector2d(0, -6));
-            if (r && visited_rooms.find(*r) == visited_rooms.end())
-                options.add(r);
-
-            if (!fleeing && options.size() > 0)
+    void onEnterRoom()
+    {
+        in_room = true;
+        if (visited_rooms.find(*current_room) == visited_rooms.end())
+        {
+            for(sp::P<DungeonObject> obj : current_room->getChildren())
             {
-                int index = sp::irandom(0, options.size() - 1);
-                for(auto room : options)
-                {
-                    if (index)
-                    {
-                        index--;
-                    }
-                    else
-                    {
-                        backtrack_list.add(current_room);
-                        current_room = room;
-                        in_room = false;
-                        break;
-                    }
-                }
+                if (obj)
+                    obj->onEnteredRoom(this);
             }
-            else if (backtrack_list.size() > 0)
+
+            if (fleeing && backtrack_list.size() > 0)
             {
-                //TODO: If we are next to a backtrack room, take that one and ignore the rest of the list.
                 for(auto room : backtrack_list)
                     current_room = room;
                 in_room = false;
                 backtrack_list.remove(current_room);
             }
-            else
-            {
-                current_room = nullptr;
-            }
         }
-        else if (current_room)
+        planMovement();
+    }
+
+    void onArriveAtCenter()
+    {
+        if (visited_rooms.find(*current_room) == visited_rooms.end())
         {
-            double speed = 0.08;
-            if (fleeing) speed *= 1.5;
-            setPosition(getPosition2D() + (current_room->getPosition2D() - getPosition2D()).normalized() * speed);
-            if (!in_room && (current_room->getPosition2D() - getPosition2D()).length() < 1.0)
+            for(sp::P<DungeonObject> obj : current_room->getChildren())
             {
-                in_room = true;
-                if (visited_rooms.find(*current_room) == visited_rooms.end())
-                {
-                    for(sp::P<DungeonObject> obj : current_room->getChildren())
-                    {
-                        if (obj)
-                            obj->onEnteredRoom(this);
-                    }
-
-                    if (fleeing)
-                    {
-                        for(auto room : backtrack_list)
-                            current_room = room;
-                        in_room = false;
-                        backtrack_list.remove(current_room);
-                    }
-                }
+                if (obj)
+                    obj->onCenterRoom(this);
             }
+            visited_rooms.insert(*current_room);
         }
-        else
+
+        sp::Vector2d position = getLogicalPosition();
+        sp::PList<DungeonRoom> options;
+        sp::P<DungeonRoom> r;
+        r = getRoomAt(getScene(), position + sp::Vector2d(4, 0));
+        if (r && visited_rooms.find(*r) == visited_rooms.end())
+            options.add(r);
+        r = getRoomAt(getScene(), position + sp::Vector2d(-4, 0));
+        if (r && visited_rooms.find(*r) == visited_rooms.end())
+            options.add(r);
+        r = getRoomAt(getScene(), position + sp::Vector2d(0, 6));
+        if (r && visited_rooms.find(*r) == visited_rooms.end())
+            options.add(r);
+        r = getRoomAt(getScene(), position + sp::Vector2d(0, -6));
+        if (r && visited_rooms.find(*r) == visited_rooms.end())
+            options.add(r);
+
+        if (!fleeing && options.size() > 0)
         {
-            setPosition(getPosition2D() + sp::Vector2d(-1, 0) * 0.1);
-            if (getPosition2D().x < -4.0)
+            int index = getSession(this).irandom(0, options.size() - 1);
+            for(auto room : options)
             {
-                if (fleeing)
+                if (index)
                 {
-                    adventurer_results.push_back({AdventurerResult::Fled, level, 0, 0.0f, loot / 80.0f, (level - courage + 1) * 1.1f});
+                    index--;
                 }
                 else
                 {
-                    adventurer_results.push_back({AdventurerResult::Escaped, level, 0, 0.0f, loot / 80.0f, -courage - level * 0.2f});
+                    backtrack_list.add(current_room);
+                    current_room = room;
+                    in_room = false;
+                    break;
                 }
-                delete this;
-                return;
             }
         }
+        else if (backtrack_list.size() > 0)
+        {
+            //TODO: If we are next to a backtrack room, take that one and ignore the rest of the list.
+            for(auto room : backtrack_list)
+                current_room = room;
+            in_room = false;
+            backtrack_list.remove(current_room);
+        }
+        else
+        {
+            current_room = nullptr;
+        }
+
         if (hp < 1)
+        {
             delete this;
+            return;
+        }
+        planMovement();
     }
 
-    bool takeDamage(int amount)
-    {
-        hp -= amount;
-        if (slimed)
-            hp -= amount;
-        if (hp > 0)
-            return false;
-        return true;
-    }
-
-    void addSlime()
-    {
-        slimed = true;
-        render_data.color = sp::HsvColor(120, 70, 100);
-    }
-
-    bool addFear(int amount)
+    void onLeaveDungeon()
     {
-        courage -= amount;
-        if (slimed)
-            courage -= amount;
-        if (courage <= 0)
-            fleeing = true;
-        return fleeing;
+        if (fleeing)
+        {
+            getSession(this).adventurer_results.push_back({AdventurerResult::Fled, level, 0, 0.0f, loot / 80.0f, (level - courage + 1) * 1.1f});
+        }
+        else
+        {
+            getSession(this).adventurer_results.push_back({AdventurerResult::Escaped, level, 0, 0.0f, loot / 80.0f, -courage - level * 0.2f});
+        }
+        delete this;
     }
 
-    int loot = 0;
-    int level;
-private:
     int hp = 1;
     int courage = 3;
     bool slimed = false;
@@ -350,10 +562,25 @@ private:
     sp::P<DungeonRoom> current_room;
     sp::PList<DungeonRoom> backtrack_list;
     std::unordered_set<DungeonRoom*> visited_rooms;
+
+    int movement_generation = 0;
+    sp::Vector2d segment_start;
+    sp::Vector2d segment_direction;
+    double segment_speed = 0.0;
+    uint64_t segment_tick = 0;
+    uint64_t segment_steps = 0;
+    Mover mover;
+
+    AllocationTag<Adventurer> allocation_tag{"Adventurer"};
 };
 
 #include "effects.h"
 #include "objects.h"
+#include "uiBinding.h"
+#include "dungeonUI.h"
+#include "dungeonSnapshot.h"
+#include "stateExporter.h"
+#include "packResourceProvider.h"
 
 class AdventurerManager : public sp::Node
 {
@@ -361,230 +588,403 @@ public:
     AdventurerManager(sp::P<sp::Node> parent)
     : sp::Node(parent)
     {
+        GameSession& session = getSession(this);
         spawn_count = 2;
-        spawn_count += std::pow(reward, 0.5);
-        spawn_count -= std::pow(risk, 0.3);
+        spawn_count += std::pow(session.reward, 0.5);
+        spawn_count -= std::pow(session.risk, 0.3);
         spawn_count = std::min(10, spawn_count);
         spawn_count = std::max(2, spawn_count);
-        max_level = std::max(1, int(1 + reward));
+        max_level = std::max(1, int(1 + session.reward));
+        if (session.forced_spawn_count > 0)
+            spawn_count = session.forced_spawn_count;
+        if (session.forced_max_level > 0)
+            max_level = session.forced_max_level;
+
+        session.timers.schedule(first_spawn_delay, this, [this]() { spawn(); });
     }
 
     virtual void onFixedUpdate() override
     {
-        if (spawn_count)
-        {
-            if (spawn_delay)
-            {
-                spawn_delay--;
-            }
-            else
-            {
-                adventurers.add(new Adventurer(getParent(), sp::irandom(1, max_level)));
-                spawn_delay = sp::irandom(80, 140);
-                spawn_count--;
-            }
-        }
-        if (adventurers.size() == 0 && spawn_count == 0)
+        if (spawn_count == 0 && !done_scheduled && adventurers.size() == 0)
         {
-            if (done_countdown)
-                done_countdown--;
-            else
-                done = true;
+            done_scheduled = true;
+            getSession(this).timers.schedule(done_delay, this, [this]() { done = true; });
         }
     }
 
     bool done = false;
 private:
-    int done_countdown = 100;
+    void spawn()
+    {
+        GameSession& session = getSession(this);
+        adventurers.add(new Adventurer(getParent(), session.irandom(1, max_level)));
+        int spawn_delay = session.irandom(session.spawn_delay_min, session.spawn_delay_max);
+        spawn_count--;
+        if (spawn_count)
+            session.timers.schedule(spawn_delay + 1, this, [this]() { spawn(); });
+    }
+
+    static constexpr int first_spawn_delay = 21;
+    static constexpr int done_delay = 100;
+
+    bool done_scheduled = false;
     int spawn_count = 5;
-    int spawn_delay = 20;
     int max_level = 1;
     sp::PList<Adventurer> adventurers;
+
+    AllocationTag<AdventurerManager> allocation_tag{"AdventurerManager"};
 };
 
-class DungeonScene : public sp::Scene
+//The dungeon camera never moves.
+static const sp::Vector2d dungeon_camera_position(8, 0);
+static const sp::Vector2d dungeon_camera_view(16, 16);
+
+void createDungeonCamera(sp::P<sp::Scene> scene)
+{
+    sp::P<sp::Camera> camera = new sp::Camera(scene->getRoot());
+    scene->setDefaultCamera(camera);
+    camera->setOrtographic(dungeon_camera_view);
+    camera->setPosition(dungeon_camera_position);
+}
+
+//Everything the dungeon camera can show: the view widened to the 4:3 window, with a margin for the size of what is drawn.
+void setDungeonVisibleArea(MoverSystem& movers)
+{
+    sp::Vector2d extent(dungeon_camera_view.x * 4.0 / 3.0 + 2.0, dungeon_camera_view.y + 2.0);
+    movers.setVisibleArea(dungeon_camera_position - extent, dungeon_camera_position + extent);
+}
+
+class DungeonScene : public sp::Scene, public DungeonCommands
 {
 public:
-    DungeonScene()
-    : sp::Scene("DUNGEON")
+    //A headless scene has no GUI, and is only stepped by the SessionHost or a SimulationThread.
+    DungeonScene(const sp::string& name, uint32_t seed, bool headless=false)
+    : sp::Scene(name), session(seed)
     {
-        main_ui.destroy();
-        main_ui = sp::gui::Loader::load("gui/main.gui", "MAIN");
+        session.headless = headless;
+        if (headless)
+            disable();
 
-        sp::P<sp::Camera> camera = new sp::Camera(getRoot());
-        setDefaultCamera(camera);
-        camera->setOrtographic(sp::Vector2d(16, 16));
-        camera->setPosition(sp::Vector2d(8, 0));
+        createDungeonCamera(this);
+        setDungeonVisibleArea(session.movers);
 
         DungeonRoom* dr;
         dr = new DungeonRoom(getRoot());
         dr->entrance = true;
         dr->doBuild();
+        updateSnapshot();
 
-        selection_indicator = new sp::Node(getRoot());
-        selection_indicator->render_data.type = sp::RenderData::Type::None;
-        selection_indicator->render_data.shader = sp::Shader::get("internal:color.shader");
-        selection_indicator->render_data.mesh = sp::MeshData::createQuad(sp::Vector2f(4, 6));
-        selection_indicator->render_data.color = sp::Color(0.15, 0.15, 0.15);
-        selection_indicator->render_data.order = -1;
+        if (!headless)
+            ui.reset(new DungeonUI(this, *this, session.cost_map));
+    }
 
+    virtual void startDay() override
+    {
+        if (!session.headless)
+            AllocationTracker::get().markDay();
+        selected_room = nullptr;
+        undo_stack.clear();
+        adventure_manager = new AdventurerManager(getRoot());
         updateUI();
+    }
 
-        main_ui->getWidgetWithID("PLAY_BUTTON")->setEventCallback([this](sp::Variant v)
-        {
-            selected_room = nullptr;
-            adventure_manager = new AdventurerManager(getRoot());
-            updateUI();
-        });
-        main_ui->getWidgetWithID("DIG")->setEventCallback([this](sp::Variant v)
-        {
-            action = "DIG";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("PIT")->setEventCallback([this](sp::Variant v)
-        {
-            action = "PIT";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("LOOT")->setEventCallback([this](sp::Variant v)
+    virtual void selectRoom(sp::Vector2d position) override
+    {
+        if (adventure_manager)
+            return;
+        selected_room = getRoomAt(this, position, true);
+        updateUI();
+    }
+
+    virtual void buildAction(const sp::string& action) override
+    {
+        undo_stack.push_back(snapshot);
+        if (!doAction(action, selected_room))
+            undo_stack.pop_back();
+        updateUI();
+    }
+
+    virtual void undo() override
+    {
+        if (adventure_manager || undo_stack.empty())
+            return;
+        restoreSnapshot(undo_stack.back());
+        undo_stack.pop_back();
+        updateUI();
+    }
+
+    bool isDayRunning()
+    {
+        return adventure_manager != nullptr;
+    }
+
+    //Publish the state of this dungeon to shared memory after every fixed update, see StateExporter.
+    void exportState(const sp::string& name)
+    {
+        state_exporter.reset(new StateExporter(name));
+    }
+
+    //Whether a build action on a room would change anything.
+    bool canDoAction(const sp::string& action, sp::P<DungeonRoom> room)
+    {
+        if (!room)
+            return false;
+        if (action == "DIG")
+            return !room->build;
+        if (action == "SELL")
+            return bool(room->main_object);
+        return !room->main_object && (action == "PIT" || action == "LOOT" || action == "FIRE" || action == "SLIME" || action == "BODY");
+    }
+
+    //Perform a build action on a room, paying for it first.
+    //Returns false when there is not enough money, or when the action would not change anything. Nothing is paid then.
+    bool doAction(const sp::string& action, sp::P<DungeonRoom> room)
+    {
+        if (!canDoAction(action, room))
+            return false;
+        if (session.cost_map.find(action) != session.cost_map.end())
         {
-            action = "LOOT";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("FIRE")->setEventCallback([this](sp::Variant v)
+            if (session.money < session.cost_map[action])
+                return false;
+            session.money -= session.cost_map[action];
+        }
+        if (action == "DIG")
+            room->doBuild();
+        else if (action == "SELL")
         {
-            action = "FIRE";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("SLIME")->setEventCallback([this](sp::Variant v)
+            session.money += room->main_object->value;
+            room->main_object.destroy();
+        }
+        else
+            room->main_object = createObject(action, room);
+        updateSnapshot();
+        return true;
+    }
+
+    //The object placed by a build action, or nullptr for actions that do not place one.
+    sp::P<DungeonObject> createObject(const sp::string& action, sp::P<DungeonRoom> room)
+    {
+        if (action == "PIT")
+            return new SpikeTrap(room);
+        if (action == "LOOT")
+            return new Loot(room);
+        if (action == "FIRE")
+            return new FireTrap(room);
+        if (action == "SLIME")
+            return new Slime(room);
+        if (action == "BODY")
+            return new Body(room);
+        return nullptr;
+    }
+
+    //Build state as a DungeonSnapshot. Kept up to date after every build action and at the end of every day.
+    const DungeonSnapshot& getSnapshot()
+    {
+        return snapshot;
+    }
+
+    EconomyState getEconomy()
+    {
+        return EconomyState{session.money, session.risk, session.reward, session.dragon_deception, session.placable_bodies};
+    }
+
+    //A snapshot of the scene made from scratch, sharing nothing with the kept one. To check that a restore matches its target.
+    DungeonSnapshot captureSnapshot()
+    {
+        DungeonSnapshot kept = snapshot;
+        snapshot = DungeonSnapshot();
+        updateSnapshot();
+        std::swap(kept, snapshot);
+        return kept;
+    }
+
+    //Bring the snapshot up to date with the scene. Only rooms that changed are replaced, the rest stays shared with older copies.
+    void updateSnapshot()
+    {
+        std::unordered_set<uint32_t> seen;
+        for(sp::P<DungeonRoom> room : getRoot()->getChildren())
         {
-            action = "SLIME";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("BODY")->setEventCallback([this](sp::Variant v)
+            if (!room)
+                continue;
+            RoomState state;
+            state.x = DungeonSnapshot::gridX(room->getPosition2D());
+            state.y = DungeonSnapshot::gridY(room->getPosition2D());
+            state.build = room->build;
+            state.entrance = room->entrance;
+            state.object = room->main_object ? room->main_object->getAction() : "";
+            state.object_value = room->main_object ? room->main_object->value : 0;
+            state.object_state = room->main_object ? room->main_object->getState() : 0;
+            uint32_t key = DungeonSnapshot::roomKey(state.x, state.y);
+            seen.insert(key);
+            const RoomState* old_state = snapshot.rooms.find(key);
+            if (!old_state || *old_state != state)
+                snapshot.rooms.set(key, state);
+        }
+        std::vector<uint32_t> removed;
+        snapshot.rooms.forEach([&seen, &removed](const RoomState& state)
         {
-            action = "BODY";
-            updateUI();
+            uint32_t key = DungeonSnapshot::roomKey(state.x, state.y);
+            if (seen.find(key) == seen.end())
+                removed.push_back(key);
         });
-        main_ui->getWidgetWithID("SELL")->setEventCallback([this](sp::Variant v)
+        for(auto key : removed)
+            snapshot.rooms.remove(key);
+
+        EconomyState economy = getEconomy();
+        if (!snapshot.economy || !(*snapshot.economy == economy))
+            snapshot.economy = std::make_shared<const EconomyState>(economy);
+    }
+
+    //Change the scene to match a snapshot, for undo or to commit a what-if branch. Only rooms that differ are touched.
+    //Only possible between days, adventurers and their effects are not part of a snapshot.
+    void restoreSnapshot(const DungeonSnapshot& target)
+    {
+        if (adventure_manager)
+            return;
+        updateSnapshot();
+
+        std::unordered_map<uint32_t, sp::P<DungeonRoom>> rooms;
+        for(sp::P<DungeonRoom> room : getRoot()->getChildren())
         {
-            action = "SELL";
-            updateUI();
-        });
-        main_ui->getWidgetWithID("BUILD_BUTTON")->setEventCallback([this](sp::Variant v)
+            if (room)
+                rooms[DungeonSnapshot::roomKey(DungeonSnapshot::gridX(room->getPosition2D()), DungeonSnapshot::gridY(room->getPosition2D()))] = room;
+        }
+        snapshot.rooms.forEachDifference(target.rooms, [this, &rooms](const RoomState* old_state, const RoomState* new_state)
         {
-            if (cost_map.find(action) != cost_map.end())
+            const RoomState* any_state = new_state ? new_state : old_state;
+            sp::P<DungeonRoom>& room = rooms[DungeonSnapshot::roomKey(any_state->x, any_state->y)];
+            if (!new_state)
             {
-                if (money < cost_map[action])
-                    return;
-                money -= cost_map[action];
+                room.destroy();
+                return;
             }
-            if (action == "DIG" && selected_room)
-                selected_room->doBuild();
-            else if (action == "PIT" && selected_room && !selected_room->main_object)
-                selected_room->main_object = new SpikeTrap(selected_room);
-            else if (action == "LOOT" && selected_room && !selected_room->main_object)
-                selected_room->main_object = new Loot(selected_room);
-            else if (action == "FIRE" && selected_room && !selected_room->main_object)
-                selected_room->main_object = new FireTrap(selected_room);
-            else if (action == "SLIME" && selected_room && !selected_room->main_object)
-                selected_room->main_object = new Slime(selected_room);
-            else if (action == "BODY" && selected_room && !selected_room->main_object)
-                selected_room->main_object = new Body(selected_room);
-            else if (action == "SELL" && selected_room && selected_room->main_object)
+            if (!room)
             {
-                money += selected_room->main_object->value;
-                selected_room->main_object.destroy();
+                room = new DungeonRoom(getRoot());
+                room->setPosition(DungeonSnapshot::worldPosition(new_state->x, new_state->y));
+            }
+            room->build = new_state->build;
+            room->entrance = new_state->entrance;
+            if (!room->main_object || room->main_object->getAction() != new_state->object)
+            {
+                room->main_object.destroy();
+                room->main_object = createObject(new_state->object, room);
+            }
+            if (room->main_object)
+            {
+                room->main_object->value = new_state->object_value;
+                room->main_object->setState(new_state->object_state);
             }
-            action = "";
-            updateUI();
         });
-        main_ui->getWidgetWithID("RESULT_DONE_BUTTON")->setEventCallback([this](sp::Variant v)
+        //Walls depend on the neighbours, so after any change every room redraws.
+        for(sp::P<DungeonRoom> room : getRoot()->getChildren())
         {
-            main_ui->getWidgetWithID("RESULT_PANEL")->hide();
-        });
+            if (room)
+                room->updateGraphics();
+        }
+
+        //A snapshot without an economy only restores the rooms.
+        if (target.economy)
+        {
+            session.money = target.economy->money;
+            session.risk = target.economy->risk;
+            session.reward = target.economy->reward;
+            session.dragon_deception = target.economy->dragon_deception;
+            session.placable_bodies = target.economy->placable_bodies;
+        }
+        snapshot = target;
+        if (!snapshot.economy)
+            snapshot.economy = std::make_shared<const EconomyState>(getEconomy());
+        updateUI();
     }
 
     virtual void onFixedUpdate() override
     {
+        auto start = std::chrono::steady_clock::now();
+        session.timers.advance();
         if (adventure_manager && adventure_manager->done)
+            endDay();
+        if (state_exporter)
+            state_exporter->publish(session, getRoot(), isDayRunning());
+        if (!session.headless)
+            effect_budget.addTick(std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void endDay()
+    {
+        for(sp::P<DungeonRoom> room : getRoot()->getChildren())
         {
-            for(sp::P<DungeonRoom> room : getRoot()->getChildren())
+            if (room)
             {
-                if (room)
+                for(sp::P<DungeonObject> obj : room->getChildren())
                 {
-                    for(sp::P<DungeonObject> obj : room->getChildren())
-                    {
-                        if (obj)
-                            obj->onEndOfDay();
-                    }
+                    if (obj)
+                        obj->onEndOfDay();
                 }
             }
-            main_ui->getWidgetWithID("RESULT_PANEL")->show();
-            while (!main_ui->getWidgetWithID("RESULT_PANEL")->getWidgetWithID("RESULT_ROWS")->getChildren().empty())
-                (*main_ui->getWidgetWithID("RESULT_PANEL")->getWidgetWithID("RESULT_ROWS")->getChildren().begin()).destroy();
-            risk *= 0.95f;
-            reward *= 0.95f;
-            dragon_deception *= 0.95f;
-            for(auto& result : adventurer_results)
+        }
+        session.risk *= 0.95f;
+        session.reward *= 0.95f;
+        session.dragon_deception *= 0.95f;
+        session.last_day_results.clear();
+        for(auto& result : session.adventurer_results)
+        {
+            switch(result.result)
             {
-                auto row = sp::gui::Loader::load("gui/main.gui", "RESULT_LINE", main_ui->getWidgetWithID("RESULT_PANEL")->getWidgetWithID("RESULT_ROWS"));
-                switch(result.result)
-                {
-                case AdventurerResult::Death:
-                    row->getWidgetWithID("RESULT")->setAttribute("caption", "Death");
-                    break;
-                case AdventurerResult::Escaped:
-                    row->getWidgetWithID("RESULT")->setAttribute("caption", "Escaped");
-                    break;
-                case AdventurerResult::Fled:
-                    row->getWidgetWithID("RESULT")->setAttribute("caption", "Fled");
-                    break;
-                }
-                std::vector<sp::string> info;
-                if (result.money > 0)
-                {
-                    money += result.money;
-                    info.push_back("$" + sp::string(result.money));
-                }
-                risk += result.risk;
-                if (result.risk > 2)
-                    info.push_back("Risk++");
-                else if (result.risk < -2)
-                    info.push_back("Risk--");
-                else if (result.risk > 0)
-                    info.push_back("Risk+");
-                else if (result.risk < 0)
-                    info.push_back("Risk-");
-                reward += result.reward;
-                if (result.reward > 2)
-                    info.push_back("Reward++");
-                else if (result.reward < -2)
-                    info.push_back("Reward--");
-                else if (result.reward > 0)
-                    info.push_back("Reward+");
-                else if (result.reward < 0)
-                    info.push_back("Reward-");
-                dragon_deception += result.deception;
-                if (result.deception > 2)
-                    info.push_back("Deception++");
-                else if (result.deception < -2)
-                    info.push_back("Deception--");
-                else if (result.deception > 0)
-                    info.push_back("Deception+");
-                else if (result.deception < 0)
-                    info.push_back("Deception-");
-                row->getWidgetWithID("INFO")->setAttribute("caption", sp::string(" ").join(info));
+            case AdventurerResult::Death:
+                session.deaths++;
+                break;
+            case AdventurerResult::Escaped:
+                session.escaped++;
+                break;
+            case AdventurerResult::Fled:
+                session.fled++;
+                break;
             }
-            adventurer_results.clear();
-            adventure_manager.destroy();
-            risk = std::max(0.0f, risk);
-            reward = std::max(0.0f, reward);
-            dragon_deception = std::max(0.0f, dragon_deception);
-            money += dragon_deception;
-            main_ui->getWidgetWithID("RESULT_PANEL")->getWidgetWithID("TRIBUTE")->setAttribute("caption", "Tribute from villages: $" + sp::string(int(dragon_deception)));
-            updateUI();
+            std::vector<sp::string> info;
+            if (result.money > 0)
+            {
+                session.money += result.money;
+                info.push_back("$" + sp::string(result.money));
+            }
+            session.risk += result.risk;
+            if (result.risk > 2)
+                info.push_back("Risk++");
+            else if (result.risk < -2)
+                info.push_back("Risk--");
+            else if (result.risk > 0)
+                info.push_back("Risk+");
+            else if (result.risk < 0)
+                info.push_back("Risk-");
+            session.reward += result.reward;
+            if (result.reward > 2)
+                info.push_back("Reward++");
+            else if (result.reward < -2)
+                info.push_back("Reward--");
+            else if (result.reward > 0)
+                info.push_back("Reward+");
+            else if (result.reward < 0)
+                info.push_back("Reward-");
+            session.dragon_deception += result.deception;
+            if (result.deception > 2)
+                info.push_back("Deception++");
+            else if (result.deception < -2)
+                info.push_back("Deception--");
+            else if (result.deception > 0)
+                info.push_back("Deception+");
+            else if (result.deception < 0)
+                info.push_back("Deception-");
+            session.last_day_results.push_back({result.result, sp::string(" ").join(info)});
         }
+        session.adventurer_results.clear();
+        adventure_manager.destroy();
+        session.risk = std::max(0.0f, session.risk);
+        session.reward = std::max(0.0f, session.reward);
+        session.dragon_deception = std::max(0.0f, session.dragon_deception);
+        session.money += session.dragon_deception;
+        session.day++;
+        updateSnapshot();
+        updateUI();
     }
 
     virtual bool onPointerDown(sp::io::Pointer::Button button, sp::Ray3d ray, int id) override
@@ -601,83 +1001,372 @@ public:
         if (adventure_manager)
             return;
 
-        selected_room = getRoomAt(sp::Vector2d(ray.start.x, ray.start.y), true);
-        action = "";
-        updateUI();
+        selectRoom(sp::Vector2d(ray.start.x, ray.start.y));
+        if (ui)
+            ui->clearAction();
     }
 
     virtual void onTextInput(const sp::string& text) override
     {
     }
 
+    virtual void onUpdate(float delta) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        session.movers.update(session.timers.getTick());
+        if (ui)
+        {
+            if (ui->isDirty())
+                fillUIModel(ui_model);
+            ui->update(delta, ui_model);
+        }
+        if (!session.headless)
+            effect_budget.addFrame(delta, std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    //Request a UI refresh, the actual widget changes are applied once per frame.
     void updateUI()
     {
-        if (adventure_manager)
+        if (ui)
+            ui->markDirty();
+    }
+
+    void fillUIModel(DungeonUIModel& model)
+    {
+        model.money = session.money;
+        model.placable_bodies = session.placable_bodies;
+        model.day_running = isDayRunning();
+        model.has_selection = selected_room != nullptr;
+        if (selected_room)
         {
-            selection_indicator->render_data.type = sp::RenderData::Type::None;
-            main_ui->getWidgetWithID("BUILD_PANEL")->hide();
-            main_ui->getWidgetWithID("INFO_PANEL")->hide();
+            model.selection_position = selected_room->getPosition2D();
+            model.selection_build = selected_room->build;
+            model.selection_has_object = selected_room->main_object != nullptr;
+            model.selection_object_value = selected_room->main_object ? selected_room->main_object->value : 0;
         }
-        else if (selected_room)
+        model.can_undo = !undo_stack.empty();
+        model.day = session.day;
+        model.tribute = session.dragon_deception;
+        model.day_results = session.last_day_results;
+    }
+
+    GameSession session;
+
+    sp::P<DungeonRoom> selected_room;
+    sp::P<AdventurerManager> adventure_manager;
+
+private:
+    DungeonSnapshot snapshot;
+    std::vector<DungeonSnapshot> undo_stack;
+    std::unique_ptr<StateExporter> state_exporter;
+
+    std::unique_ptr<DungeonUI> ui;
+    DungeonUIModel ui_model;
+};
+
+GameSession& getSession(sp::P<sp::Node> node)
+{
+    sp::P<DungeonScene> scene = node->getScene();
+    return scene->session;
+}
+
+#include "sessionHost.h"
+#include "simulationThread.h"
+#include "scenario.h"
+#include "scenarioBaseline.h"
+#include "dungeonFuzzer.h"
+
+int runHeadless(int session_count, int days, int thread_count, uint32_t seed, bool check_allocations)
+{
+    LOG(Info, "Running", session_count, "headless sessions for", days, "days on", thread_count, "threads, seed", seed);
+    auto start = std::chrono::steady_clock::now();
+    SessionHost host(thread_count);
+    host.setCheckAllocations(check_allocations);
+    std::vector<SessionReport> reports = host.run(session_count, days, seed);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int result = 0;
+    int64_t total_ticks = 0;
+    for(auto& report : reports)
+    {
+        for(auto& growth : report.allocation_growth)
         {
-            selection_indicator->setPosition(selected_room->getPosition2D());
-            selection_indicator->render_data.type = sp::RenderData::Type::Normal;
-            main_ui->getWidgetWithID("INFO_PANEL")->show();
-            main_ui->getWidgetWithID("BUILD_PANEL")->show();
-            main_ui->getWidgetWithID("DIG")->setVisible(!selected_room->build);
-            main_ui->getWidgetWithID("PIT")->setVisible(selected_room->build && !selected_room->main_object);
-            main_ui->getWidgetWithID("LOOT")->setVisible(selected_room->build && !selected_room->main_object);
-            main_ui->getWidgetWithID("FIRE")->setVisible(selected_room->build && !selected_room->main_object);
-            main_ui->getWidgetWithID("SLIME")->setVisible(selected_room->build && !selected_room->main_object);
-            main_ui->getWidgetWithID("BODY")->setVisible(selected_room->build && !selected_room->main_object && placable_bodies > 0);
-            main_ui->getWidgetWithID("SELL")->setVisible(selected_room->build && selected_room->main_object && selected_room->main_object->value > 0);
+            LOG(Error, "Session with seed", report.seed, "leaks:", growth);
+            result = 1;
+        }
+        LOG(Info, "seed:", report.seed, "days:", report.days, "rooms:", report.rooms, "money:", report.money,
+            "risk:", report.risk, "reward:", report.reward, "deception:", report.dragon_deception,
+            "deaths:", report.deaths, "fled:", report.fled, "escaped:", report.escaped,
+            "ticks:", report.ticks, "time:", report.seconds);
+        for(auto& line : report.allocation_days)
+            LOG(Info, line);
+        total_ticks += report.ticks;
+    }
+    LOG(Info, "Simulated", total_ticks, "ticks in", seconds, "seconds,", total_ticks / std::max(seconds, 0.001), "ticks per second");
+    for(auto& line : AllocationTracker::get().getReport())
+        LOG(Info, line);
+    return result;
+}
+
+//Play a live headless dungeon for some days, then simulate what-if branches of build actions on top of it side by side,
+//and commit the branch with the most dragon deception back to the live dungeon.
+//Fails when the dungeon after the commit is not the dungeon of the chosen branch.
+int runBranches(int branch_count, int days, int thread_count, uint32_t seed)
+{
+    LOG(Info, "Simulating", branch_count, "branches for", days, "days on", thread_count, "threads, seed", seed);
+    sp::P<DungeonScene> live = new DungeonScene("LIVE", seed, true);
+    for(int day=0; day<days; day++)
+    {
+        autoBuild(live);
+        live->startDay();
+        for(int tick=0; tick<SessionHost::max_ticks_per_day && live->isDayRunning(); tick++)
+            fixedUpdateScene(live);
+    }
+    if (live->isDayRunning())
+    {
+        LOG(Error, "Live dungeon did not finish its days");
+        live.destroy();
+        return 1;
+    }
+
+    std::mt19937 random_engine(seed);
+    std::vector<DungeonBranch> branches;
+    for(int n=0; n<branch_count; n++)
+        branches.push_back(randomBranch(live->getSnapshot(), random_engine, 5));
+    SessionHost host(thread_count);
+    std::vector<SessionReport> reports = host.runBranches(branches, days, seed + 1);
+
+    size_t best = 0;
+    for(size_t n=0; n<reports.size(); n++)
+    {
+        const SessionReport& report = reports[n];
+        LOG(Info, "branch:", n, "actions:", branches[n].actions.size(), "rooms:", report.rooms, "money:", report.money,
+            "deception:", report.dragon_deception, "deaths:", report.deaths, "fled:", report.fled, "escaped:", report.escaped);
+        if (report.dragon_deception > reports[best].dragon_deception
+            || (report.dragon_deception == reports[best].dragon_deception && report.money > reports[best].money))
+            best = n;
+    }
+
+    live->restoreSnapshot(reports[best].snapshot);
+    bool committed = live->captureSnapshot().equals(reports[best].snapshot);
+    live.destroy();
+    if (!committed)
+    {
+        LOG(Error, "Dungeon after committing branch", best, "differs from the branch");
+        return 1;
+    }
+    LOG(Info, "Committed branch", best);
+    return 0;
+}
 
-            main_ui->getWidgetWithID("BUILD_BUTTON")->setVisible(action != "");
-            main_ui->getWidgetWithID("BUILD_BUTTON")->setAttribute("caption", action != "SELL" ? "[BUILD]" : "[SELL]");
+int runFuzzer(int iterations, uint32_t seed, const sp::string& output_prefix)
+{
+    LOG(Info, "Fuzzing", iterations, "scenarios, seed", seed);
+    DungeonFuzzer fuzzer(seed);
+    std::vector<DungeonFuzzer::Candidate> worst = fuzzer.run(iterations, 3);
+    fuzzer.save(worst, output_prefix);
+    return 0;
+}
+
+//Play each scenario, and compare the result with the baseline next to it, or record that baseline.
+//Exit code of a scenario run that found no regression, but had scenarios without a baseline to compare with.
+//The same as the skip code of automake, ctest reports it as skipped through SKIP_RETURN_CODE.
+static constexpr int missing_baseline_exit_code = 77;
+
+int runScenarios(const std::vector<sp::string>& filenames, int runs, bool record_baselines, double tolerance_scale)
+{
+    int result = 0;
+    bool missing_baseline = false;
+    for(auto& filename : filenames)
+    {
+        Scenario scenario;
+        if (!scenario.load(filename))
+        {
+            result = 1;
+            continue;
         }
-        else
+        ScenarioResult report = ScenarioRunner::runMedian(scenario, runs, [](const ScenarioResult& r) { return r.mean_tick; });
+        for(auto& line : ScenarioRunner::describe(report))
+            LOG(Info, filename, line);
+        if (!report.finished)
         {
-            selection_indicator->render_data.type = sp::RenderData::Type::None;
-            main_ui->getWidgetWithID("INFO_PANEL")->show();
-            main_ui->getWidgetWithID("BUILD_PANEL")->hide();
-            main_ui->getWidgetWithID("BUILD_BUTTON")->hide();
+            LOG(Error, filename, "ran into the tick limit of", SessionHost::max_ticks_per_day, "per day");
+            result = 1;
         }
 
-        sp::string info = "Money: " + sp::string(money);
-        if (action == "DIG")
-            info += "\nDig a new room.\nExpand your dungeon.";
-        else if (action == "PIT")
-            info += "\nBuild a spike pit\nSimple device,\nbut effective.";
-        else if (action == "LOOT")
-            info += "\nPlace a pile of gold\nto find.\nIf someone escapes\nwith this.\nIt will bring\nMore and better\nadventurers.";
-        else if (action == "FIRE")
-            info += "\nFire trap, burns\nadventurers.\nAdds a lot of\ndeception\non a kill.";
-        else if (action == "SLIME")
-            info += "\nSlime trap.\nMade with powered\ninsta-slime.\nIncreases damage\nand fear from other\ntraps.";
-        else if (action == "BODY")
-            info += "\nPlace a dead body.\nDecays after a\nfew days.\nAdds fear.\nAmount:" + sp::string(placable_bodies);
-        else if (action == "SELL")
-            info += "\nSell back for: $" + sp::string(selected_room->main_object->value);
-        if (cost_map.find(action) != cost_map.end())
+        ScenarioBaseline baseline;
+        sp::string baseline_filename = ScenarioBaseline::getFilename(filename);
+        bool has_baseline = baseline.load(baseline_filename);
+        if (record_baselines)
+        {
+            baseline.record(report);
+            if (baseline.save(baseline_filename, {"Recorded with --record-baselines, median of " + sp::string(runs) + " runs by mean tick"}))
+                LOG(Info, "Recorded", baseline_filename);
+        }
+        else if (!has_baseline)
         {
-            info += "\nCost: $" + sp::string(cost_map[action]);
+            LOG(Warning, filename, "has no baseline, record one with --record-baselines");
+            missing_baseline = true;
+        }
+        else if (!baseline.compare(filename, report, tolerance_scale))
+        {
+            result = 1;
         }
-        main_ui->getWidgetWithID("INFO_LABEL")->setAttribute("caption", info);
     }
+    if (result == 0 && missing_baseline)
+        return missing_baseline_exit_code;
+    return result;
+}
 
-    sp::P<DungeonRoom> selected_room;
-    sp::P<sp::Node> selection_indicator;
+//Parse a whole command line value. Returns false for anything that is not a number in range, trailing text included.
+bool parseArgument(const char* text, int& value)
+{
+    char* end;
+    errno = 0;
+    long result = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || result < std::numeric_limits<int>::min() || result > std::numeric_limits<int>::max())
+        return false;
+    value = result;
+    return true;
+}
 
-    sp::P<AdventurerManager> adventure_manager;
-    sp::string action;
-};
+bool parseArgument(const char* text, uint32_t& value)
+{
+    char* end;
+    errno = 0;
+    unsigned long long result = strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || text[0] == '-' || errno == ERANGE || result > std::numeric_limits<uint32_t>::max())
+        return false;
+    value = result;
+    return true;
+}
+
+bool parseArgument(const char* text, double& value)
+{
+    char* end;
+    errno = 0;
+    double result = strtod(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE)
+        return false;
+    value = result;
+    return true;
+}
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        << "  --seed N                 Seed of the game, or of the headless runs.\n"
+        << "  --threaded               Run the simulation on its own thread.\n"
+        << "  --export-state [NAME]    Publish the dungeon state to shared memory NAME.\n"
+        << "  --headless N             Run N headless sessions and exit.\n"
+        << "  --days N                 Days per headless session (10).\n"
+        << "  --threads N              Worker threads for headless sessions.\n"
+        << "  --check-allocations      Fail headless sessions that keep growing.\n"
+        << "  --branches N             Play --days days, simulate N what-if branches and commit the best.\n"
+        << "  --fuzz N                 Try N fuzzed scenarios, and save the worst.\n"
+        << "  --fuzz-out PREFIX        File prefix of the saved scenarios (fuzz_worst_).\n"
+        << "  --scenario FILE...       Run scenarios, and compare them with their baselines.\n"
+        << "                           Exits with 77 when nothing regressed, but a scenario has no baseline.\n"
+        << "  --runs N                 Runs per scenario (3).\n"
+        << "  --record-baselines       Record the baselines instead of comparing.\n"
+        << "  --tolerance-scale F      Multiply all baseline tolerances by F.\n";
+}
 
 int main(int argc, char** argv)
 {
+    int headless_sessions = 0;
+    int headless_days = 10;
+    int headless_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t seed = std::random_device()();
+    bool check_allocations = false;
+    bool threaded = false;
+    sp::string export_name;
+    int branch_count = 0;
+    int fuzz_iterations = 0;
+    sp::string fuzz_output = "fuzz_worst_";
+    std::vector<sp::string> scenario_files;
+    int scenario_runs = 3;
+    bool record_baselines = false;
+    double tolerance_scale = 1.0;
+    for(int n=1; n<argc; n++)
+    {
+        sp::string arg = argv[n];
+        bool valid = true;
+        if (arg == "--headless")
+            valid = n + 1 < argc && parseArgument(argv[++n], headless_sessions) && headless_sessions >= 0;
+        else if (arg == "--days")
+            valid = n + 1 < argc && parseArgument(argv[++n], headless_days) && headless_days > 0;
+        else if (arg == "--threads")
+            valid = n + 1 < argc && parseArgument(argv[++n], headless_threads) && headless_threads > 0;
+        else if (arg == "--seed")
+            valid = n + 1 < argc && parseArgument(argv[++n], seed);
+        else if (arg == "--check-allocations")
+            check_allocations = true;
+        else if (arg == "--threaded")
+            threaded = true;
+        else if (arg == "--export-state")
+            export_name = n + 1 < argc && argv[n + 1][0] != '-' ? sp::string(argv[++n]) : sp::string(state_export_default_name);
+        else if (arg == "--branches")
+            valid = n + 1 < argc && parseArgument(argv[++n], branch_count) && branch_count >= 0;
+        else if (arg == "--fuzz")
+            valid = n + 1 < argc && parseArgument(argv[++n], fuzz_iterations) && fuzz_iterations >= 0;
+        else if (arg == "--fuzz-out")
+        {
+            valid = n + 1 < argc;
+            if (valid)
+                fuzz_output = argv[++n];
+        }
+        else if (arg == "--scenario")
+        {
+            while(n + 1 < argc && argv[n + 1][0] != '-')
+                scenario_files.push_back(argv[++n]);
+            valid = !scenario_files.empty();
+        }
+        else if (arg == "--runs")
+            valid = n + 1 < argc && parseArgument(argv[++n], scenario_runs) && scenario_runs > 0;
+        else if (arg == "--record-baselines")
+            record_baselines = true;
+        else if (arg == "--tolerance-scale")
+            valid = n + 1 < argc && parseArgument(argv[++n], tolerance_scale) && tolerance_scale >= 0.0;
+        else if (arg == "--help" || arg == "-h")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+            LOG(Warning, "Ignoring unknown argument", arg);
+        if (!valid)
+        {
+            std::cerr << "Missing or invalid value for " << arg << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
     sp::P<sp::Engine> engine = new sp::Engine();
 
+    if (headless_sessions > 0)
+        return runHeadless(headless_sessions, headless_days, headless_threads, seed, check_allocations);
+    if (branch_count > 0)
+        return runBranches(branch_count, headless_days, headless_threads, seed);
+    if (fuzz_iterations > 0)
+        return runFuzzer(fuzz_iterations, seed, fuzz_output);
+    if (!scenario_files.empty())
+        return runScenarios(scenario_files, scenario_runs, record_baselines, tolerance_scale);
+
     //Create resource providers, so we can load things.
-    new sp::io::DirectoryResourceProvider("resources");
+    //Prefer the packed archive made by the build, and fall back to the loose files when it is not there.
+    //Debug builds use the loose files when they are there, so a stale pack does not hide resources that are being edited.
+    sp::P<PackResourceProvider> pack_provider;
+#ifdef DEBUG
+    struct stat resources_stat;
+    if (stat("resources", &resources_stat) != 0 || !S_ISDIR(resources_stat.st_mode))
+#endif
+        pack_provider = new PackResourceProvider("resources.pack");
+    if (pack_provider && !pack_provider->isValid())
+        pack_provider.destroy();
+    if (!pack_provider)
+        new sp::io::DirectoryResourceProvider("resources");
 
     //Disable or enable smooth filtering by default, enabling it gives nice smooth looks, but disabling it gives a more pixel art look.
     sp::texture_manager.setDefaultSmoothFiltering(true);
@@ -691,7 +1380,7 @@ int main(int argc, char** argv)
 
     sp::gui::Theme::loadTheme("default", "gui/theme/basic.theme.txt");
     new sp::gui::Scene(sp::Vector2d(640, 480));
-    main_font = sp::font_manager.get("gui/theme/NanumGothicCoding-Bold.ttf");
+    prepareWorldText();
 
     sp::P<sp::SceneGraphicsLayer> scene_layer = new sp::SceneGraphicsLayer(1);
     scene_layer->addRenderPass(new sp::BasicNodeRenderPass());
@@ -700,10 +1389,22 @@ int main(int argc, char** argv)
 #endif
     window->addLayer(scene_layer);
 
-    main_ui = sp::gui::Loader::load("gui/menu.gui", "MENU", nullptr, true);
-    main_ui->getWidgetWithID("PLAY_BUTTON")->setEventCallback([](sp::Variant v)
+    sp::P<sp::gui::Widget> menu = sp::gui::Loader::load("gui/menu.gui", "MENU", nullptr, true);
+    menu->getWidgetWithID("PLAY_BUTTON")->setEventCallback([menu, seed, threaded, export_name](sp::Variant v)
     {
-        new DungeonScene();
+        //With --threaded the game runs on a simulation thread, and the engine only renders snapshots of it.
+        if (threaded)
+        {
+            new DungeonView("DUNGEON", seed, export_name);
+        }
+        else
+        {
+            sp::P<DungeonScene> scene = new DungeonScene("DUNGEON", seed);
+            if (!export_name.empty())
+                scene->exportState(export_name);
+        }
+        sp::P<sp::gui::Widget> menu_widget = menu;
+        menu_widget.destroy();
     });
 
     engine->run();
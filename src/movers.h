@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+class MoverSystem;
+
+//Handle of a node in a MoverSystem. Part of the node that moves, removes itself from the system when destroyed.
+class Mover
+{
+public:
+    Mover() {}
+    Mover(const Mover&) = delete;
+    Mover& operator=(const Mover&) = delete;
+    ~Mover();
+
+private:
+    MoverSystem* system = nullptr;
+    int index = -1;
+    bool damped = false;
+
+    friend class MoverSystem;
+};
+
+//Positions of all moving nodes of a session, kept in flat float arrays so they are updated with a single SIMD kernel.
+//Linear movers follow a straight segment: start + velocity * min(age, steps), with age in ticks.
+//Damped movers are stepped every tick: position += velocity * step, velocity *= damping.
+//Gameplay never reads these positions, they only exist for rendering, so update() is only called when drawing,
+//and only movers inside the visible area are written to their nodes.
+//A mover is written to its node until its visible_until tick, once more after that, and then leaves the system:
+//a linear mover at the end of its segment, a damped mover when it can no longer be seen.
+//Ticks are stored as floats relative to an epoch that is moved forward regularly, so they stay exact integers however long a session runs.
+class MoverSystem
+{
+public:
+    ~MoverSystem()
+    {
+        for(auto handle : linear.handles)
+            handle->system = nullptr;
+        for(auto handle : damped.handles)
+            handle->system = nullptr;
+    }
+
+    void setLinear(Mover& mover, sp::P<sp::Node> node, sp::Vector2d start, sp::Vector2d velocity, uint64_t start_tick, uint64_t steps)
+    {
+        if (mover.system && mover.damped)
+            remove(mover);
+        if (!mover.system)
+            add(linear, mover, node, false);
+        int n = mover.index;
+        linear.x[n] = start.x;
+        linear.y[n] = start.y;
+        linear.velocity_x[n] = velocity.x;
+        linear.velocity_y[n] = velocity.y;
+        linear.start_tick[n] = relativeTick(start_tick);
+        linear.steps[n] = steps;
+        linear.visible_until[n] = relativeTick(start_tick + steps + 1);
+        linear.start_x[n] = start.x;
+        linear.start_y[n] = start.y;
+    }
+
+    void setDamped(Mover& mover, sp::P<sp::Node> node, sp::Vector2d start, sp::Vector2d velocity, uint64_t current_tick, uint64_t visible_until)
+    {
+        //Bring everything else up to date first, so the new mover starts stepping from now.
+        //A session that is never drawn never steps its damped movers, not here either.
+        if (drawn)
+            advanceDamped(current_tick);
+        else
+            damped_tick = current_tick;
+        if (mover.system && !mover.damped)
+            remove(mover);
+        if (!mover.system)
+            add(damped, mover, node, true);
+        int n = mover.index;
+        damped.x[n] = start.x;
+        damped.y[n] = start.y;
+        damped.velocity_x[n] = velocity.x;
+        damped.velocity_y[n] = velocity.y;
+        damped.visible_until[n] = relativeTick(visible_until);
+    }
+
+    //Only movers in this part of the world are written to their nodes. Positions are relative to the parent of the node,
+    //which is assumed to be translated but not rotated or scaled. Everything is visible until this is called.
+    void setVisibleArea(sp::Vector2d min, sp::Vector2d max)
+    {
+        visible_min_x = min.x;
+        visible_min_y = min.y;
+        visible_max_x = max.x;
+        visible_max_y = max.y;
+    }
+
+    void update(uint64_t current_tick)
+    {
+        drawn = true;
+        float tick = relativeTick(current_tick);
+        stepLinear(tick);
+        advanceDamped(current_tick);
+        writeBack(linear, tick);
+        writeBack(damped, tick);
+    }
+
+    static constexpr float damped_step = 0.1f;
+    static constexpr float damping = 0.99f;
+    //Ticks since the epoch stay far below 2^24, the last integer a float holds exactly.
+    static constexpr uint64_t epoch_interval = 1 << 20;
+
+private:
+    struct Group
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> velocity_x;
+        std::vector<float> velocity_y;
+        std::vector<float> start_x;
+        std::vector<float> start_y;
+        std::vector<float> start_tick;
+        std::vector<float> steps;
+        std::vector<float> visible_until;
+        std::vector<float> origin_x; //World position of the parent of the node.
+        std::vector<float> origin_y;
+        std::vector<uint8_t> shown; //Written to the node by the last update().
+        std::vector<sp::P<sp::Node>> nodes;
+        std::vector<Mover*> handles;
+
+        void resize(size_t size)
+        {
+            for(auto array : {&x, &y, &velocity_x, &velocity_y, &start_x, &start_y, &start_tick, &steps, &visible_until, &origin_x, &origin_y})
+                array->resize(size);
+            shown.resize(size);
+            nodes.resize(size);
+            handles.resize(size);
+        }
+    };
+
+    //A tick relative to the epoch. Moves the epoch forward when tick is too far past it.
+    float relativeTick(uint64_t tick)
+    {
+        if (tick >= epoch + epoch_interval)
+        {
+            float shift = float(tick - epoch);
+            for(Group* group : {&linear, &damped})
+            {
+                for(auto array : {&group->start_tick, &group->visible_until})
+                {
+                    for(auto& value : *array)
+                        value -= shift;
+                }
+            }
+            epoch = tick;
+        }
+        return float(int64_t(tick - epoch));
+    }
+
+    void add(Group& group, Mover& mover, sp::P<sp::Node> node, bool is_damped)
+    {
+        int n = group.handles.size();
+        group.resize(n + 1);
+        sp::Vector2d origin;
+        for(sp::P<sp::Node> parent = node ? node->getParent() : nullptr; parent; parent = parent->getParent())
+            origin += parent->getPosition2D();
+        group.origin_x[n] = origin.x;
+        group.origin_y[n] = origin.y;
+        group.shown[n] = true;
+        group.nodes[n] = node;
+        group.handles[n] = &mover;
+        mover.system = this;
+        mover.index = n;
+        mover.damped = is_damped;
+    }
+
+    void remove(Mover& mover)
+    {
+        Group& group = mover.damped ? damped : linear;
+        int n = mover.index;
+        int last = group.handles.size() - 1;
+        if (n != last)
+        {
+            for(auto array : {&group.x, &group.y, &group.velocity_x, &group.velocity_y, &group.start_x, &group.start_y, &group.start_tick, &group.steps, &group.visible_until, &group.origin_x, &group.origin_y})
+                (*array)[n] = (*array)[last];
+            group.shown[n] = group.shown[last];
+            group.nodes[n] = group.nodes[last];
+            group.handles[n] = group.handles[last];
+            group.handles[n]->index = n;
+        }
+        group.resize(last);
+        mover.system = nullptr;
+        mover.index = -1;
+    }
+
+    void stepLinear(float tick)
+    {
+        float* x = linear.x.data();
+        float* y = linear.y.data();
+        const float* sx = linear.start_x.data();
+        const float* sy = linear.start_y.data();
+        const float* vx = linear.velocity_x.data();
+        const float* vy = linear.velocity_y.data();
+        const float* t0 = linear.start_tick.data();
+        const float* steps = linear.steps.data();
+        size_t count = linear.handles.size();
+        size_t n = 0;
+#if defined(__AVX__)
+        __m256 now = _mm256_set1_ps(tick);
+        __m256 zero = _mm256_setzero_ps();
+        for(; n + 8 <= count; n += 8)
+        {
+            __m256 age = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(now, _mm256_loadu_ps(t0 + n)), zero), _mm256_loadu_ps(steps + n));
+            _mm256_storeu_ps(x + n, _mm256_add_ps(_mm256_loadu_ps(sx + n), _mm256_mul_ps(_mm256_loadu_ps(vx + n), age)));
+            _mm256_storeu_ps(y + n, _mm256_add_ps(_mm256_loadu_ps(sy + n), _mm256_mul_ps(_mm256_loadu_ps(vy + n), age)));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        __m128 now = _mm_set1_ps(tick);
+        __m128 zero = _mm_setzero_ps();
+        for(; n + 4 <= count; n += 4)
+        {
+            __m128 age = _mm_min_ps(_mm_max_ps(_mm_sub_ps(now, _mm_loadu_ps(t0 + n)), zero), _mm_loadu_ps(steps + n));
+            _mm_storeu_ps(x + n, _mm_add_ps(_mm_loadu_ps(sx + n), _mm_mul_ps(_mm_loadu_ps(vx + n), age)));
+            _mm_storeu_ps(y + n, _mm_add_ps(_mm_loadu_ps(sy + n), _mm_mul_ps(_mm_loadu_ps(vy + n), age)));
+        }
+#endif
+        for(; n < count; n++)
+        {
+            float age = std::min(std::max(tick - t0[n], 0.0f), steps[n]);
+            x[n] = sx[n] + vx[n] * age;
+            y[n] = sy[n] + vy[n] * age;
+        }
+    }
+
+    void advanceDamped(uint64_t current_tick)
+    {
+        if (damped.handles.empty())
+            damped_tick = current_tick;
+        for(; damped_tick < current_tick; damped_tick++)
+            stepDamped();
+    }
+
+    void stepDamped()
+    {
+        float* x = damped.x.data();
+        float* y = damped.y.data();
+        float* vx = damped.velocity_x.data();
+        float* vy = damped.velocity_y.data();
+        size_t count = damped.handles.size();
+        size_t n = 0;
+#if defined(__AVX__)
+        __m256 step = _mm256_set1_ps(damped_step);
+        __m256 damp = _mm256_set1_ps(damping);
+        for(; n + 8 <= count; n += 8)
+        {
+            __m256 velocity_x = _mm256_loadu_ps(vx + n);
+            __m256 velocity_y = _mm256_loadu_ps(vy + n);
+            _mm256_storeu_ps(x + n, _mm256_add_ps(_mm256_loadu_ps(x + n), _mm256_mul_ps(velocity_x, step)));
+            _mm256_storeu_ps(y + n, _mm256_add_ps(_mm256_loadu_ps(y + n), _mm256_mul_ps(velocity_y, step)));
+            _mm256_storeu_ps(vx + n, _mm256_mul_ps(velocity_x, damp));
+            _mm256_storeu_ps(vy + n, _mm256_mul_ps(velocity_y, damp));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        __m128 step = _mm_set1_ps(damped_step);
+        __m128 damp = _mm_set1_ps(damping);
+        for(; n + 4 <= count; n += 4)
+        {
+            __m128 velocity_x = _mm_loadu_ps(vx + n);
+            __m128 velocity_y = _mm_loadu_ps(vy + n);
+            _mm_storeu_ps(x + n, _mm_add_ps(_mm_loadu_ps(x + n), _mm_mul_ps(velocity_x, step)));
+            _mm_storeu_ps(y + n, _mm_add_ps(_mm_loadu_ps(y + n), _mm_mul_ps(velocity_y, step)));
+            _mm_storeu_ps(vx + n, _mm_mul_ps(velocity_x, damp));
+            _mm_storeu_ps(vy + n, _mm_mul_ps(velocity_y, damp));
+        }
+#endif
+        for(; n < count; n++)
+        {
+            x[n] += vx[n] * damped_step;
+            y[n] += vy[n] * damped_step;
+            vx[n] *= damping;
+            vy[n] *= damping;
+        }
+    }
+
+    //Backwards, so removing a settled mover only moves one that was already handled.
+    //A mover that leaves the visible area is written once more, so its node is not left behind inside it.
+    void writeBack(Group& group, float tick)
+    {
+        for(size_t n=group.handles.size(); n-- > 0; )
+        {
+            float world_x = group.x[n] + group.origin_x[n];
+            float world_y = group.y[n] + group.origin_y[n];
+            bool visible = world_x >= visible_min_x && world_x <= visible_max_x && world_y >= visible_min_y && world_y <= visible_max_y;
+            if ((visible || group.shown[n]) && group.nodes[n])
+                group.nodes[n]->setPosition(sp::Vector2d(group.x[n], group.y[n]));
+            group.shown[n] = visible;
+            if (tick >= group.visible_until[n])
+                remove(*group.handles[n]);
+        }
+    }
+
+    Group linear;
+    Group damped;
+    uint64_t damped_tick = 0;
+    uint64_t epoch = 0;
+    bool drawn = false; //Set by the first update().
+    float visible_min_x = std::numeric_limits<float>::lowest();
+    float visible_min_y = std::numeric_limits<float>::lowest();
+    float visible_max_x = std::numeric_limits<float>::max();
+    float visible_max_y = std::numeric_limits<float>::max();
+
+    friend class Mover;
+};
+
+inline Mover::~Mover()
+{
+    if (system)
+        system->remove(*this);
+}
@@ -1,11 +1,21 @@
 
+//The body left behind by a trap kill, removed again at the end of the day.
+class TrapBody : public sp::Node
+{
+public:
+    using sp::Node::Node;
+
+private:
+    AllocationTag<TrapBody> allocation_tag{"TrapBody"};
+};
+
 class SpikeTrap : public DungeonObject
 {
 public:
     SpikeTrap(sp::P<DungeonRoom> room)
     : DungeonObject(room)
     {
-        value = cost_map["PIT"];
+        value = getSession(this).cost_map["PIT"];
         buildString(render_data, "^^^");
         render_data.scale = sp::Vector3f(0.6, 0.6, 0.6);
         render_data.color = sp::HsvColor(0, 70, 100);
@@ -18,7 +28,7 @@ public:
         if (body)
         {
             adventurer->addFear(1);
-            new ScaredEffect(adventurer);
+            ScaredEffect::spawn(adventurer);
         }
     }
 
@@ -29,14 +39,14 @@ public:
             active = false;
             if (adventurer->takeDamage(1))
             {
-                body = new sp::Node(getParent());
+                body = new TrapBody(getParent());
                 buildString(body->render_data, "@");
                 body->render_data.scale = sp::Vector3f(1.5, 1.5, 1.5);
                 body->render_data.color = sp::HsvColor(0, 80, 70);
                 body->render_data.order = 2;
                 body->setRotation(90);
 
-                adventurer_results.push_back({AdventurerResult::Death, adventurer->level, adventurer->loot + 20 + adventurer->level * 30, float(adventurer->level) * 1.5f, 0.0f, 0.0f});
+                getSession(this).adventurer_results.push_back({AdventurerResult::Death, adventurer->level, adventurer->loot + 20 + adventurer->level * 30, float(adventurer->level) * 1.5f, 0.0f, 0.0f});
             }
         }
     }
@@ -45,13 +55,31 @@ public:
     {
         active = true;
         if (body)
-            placable_bodies += 1;
+            getSession(this).placable_bodies += 1;
         body.destroy();
     }
 
+    virtual const char* getAction() override
+    {
+        return "PIT";
+    }
+
+    //Bit 0: armed, bit 1: a body lies in the pit.
+    virtual int getState() override
+    {
+        return (active ? 1 : 0) | (body ? 2 : 0);
+    }
+
+    virtual void setState(int state) override
+    {
+        active = state & 1;
+    }
+
 private:
     bool active = true;
     sp::P<sp::Node> body;
+
+    AllocationTag<SpikeTrap> allocation_tag{"SpikeTrap"};
 };
 
 
@@ -61,7 +89,7 @@ public:
     Loot(sp::P<DungeonRoom> room)
     : DungeonObject(room)
     {
-        value = cost_map["LOOT"];
+        value = getSession(this).cost_map["LOOT"];
         buildString(render_data, "%");
         render_data.scale = sp::Vector3f(1.1, 1.1, 1.1);
         render_data.color = sp::HsvColor(60, 100, 100);
@@ -83,7 +111,13 @@ public:
     {
     }
 
+    virtual const char* getAction() override
+    {
+        return "LOOT";
+    }
+
 private:
+    AllocationTag<Loot> allocation_tag{"Loot"};
 };
 
 class Body : public DungeonObject
@@ -102,7 +136,7 @@ public:
     virtual void onEnteredRoom(sp::P<Adventurer> adventurer) override
     {
         adventurer->addFear(1);
-        new ScaredEffect(adventurer);
+        ScaredEffect::spawn(adventurer);
     }
 
     virtual void onCenterRoom(sp::P<Adventurer> adventurer) override
@@ -117,8 +151,28 @@ public:
             delete this;
     }
 
+    virtual const char* getAction() override
+    {
+        return "BODY";
+    }
+
+    virtual int getState() override
+    {
+        return decay;
+    }
+
+    virtual void setState(int state) override
+    {
+        decay = state;
+        if (decay < initial_decay)
+            render_data.color = sp::HsvColor(0, 80, 20 + decay * 10);
+    }
+
 private:
-    int decay = 5;
+    static constexpr int initial_decay = 5;
+    int decay = initial_decay;
+
+    AllocationTag<Body> allocation_tag{"Body"};
 };
 
 class Slime : public DungeonObject
@@ -136,7 +190,7 @@ public:
     virtual void onEnteredRoom(sp::P<Adventurer> adventurer) override
     {
         adventurer->addSlime();
-        new ScaredEffect(adventurer);
+        ScaredEffect::spawn(adventurer);
     }
 
     virtual void onCenterRoom(sp::P<Adventurer> adventurer) override
@@ -151,8 +205,28 @@ public:
             delete this;
     }
 
+    virtual const char* getAction() override
+    {
+        return "SLIME";
+    }
+
+    virtual int getState() override
+    {
+        return decay;
+    }
+
+    virtual void setState(int state) override
+    {
+        decay = state;
+        if (decay < initial_decay)
+            render_data.color = sp::HsvColor(0, 80, 20 + decay * 10);
+    }
+
 private:
-    int decay = 5;
+    static constexpr int initial_decay = 5;
+    int decay = initial_decay;
+
+    AllocationTag<Slime> allocation_tag{"Slime"};
 };
 
 class FireTrap : public DungeonObject
@@ -161,7 +235,7 @@ public:
     FireTrap(sp::P<DungeonRoom> room)
     : DungeonObject(room)
     {
-        value = cost_map["FIRE"];
+        value = getSession(this).cost_map["FIRE"];
         buildString(render_data, "> <");
         render_data.scale = sp::Vector3f(0.8, 0.8, 0.8);
         render_data.color = sp::HsvColor(0, 70, 100);
@@ -173,7 +247,7 @@ public:
         if (body)
         {
             adventurer->addFear(2);
-            new ScaredEffect(adventurer);
+            ScaredEffect::spawn(adventurer);
         }
     }
 
@@ -182,18 +256,19 @@ public:
         if (active)
         {
             active = false;
-            for(int n=0; n<100; n++)
+            int effect_count = effect_budget.scaleCount(100, max_fire_effects);
+            for(int n=0; n<effect_count; n++)
                 new FireEffect(this);
             if (adventurer->takeDamage(4))
             {
-                body = new sp::Node(getParent());
+                body = new TrapBody(getParent());
                 buildString(body->render_data, "@");
                 body->render_data.scale = sp::Vector3f(1.5, 1.5, 1.5);
                 body->render_data.color = sp::HsvColor(0, 10, 50);
                 body->render_data.order = 2;
                 body->setRotation(90);
 
-                adventurer_results.push_back({AdventurerResult::Death, adventurer->level, adventurer->loot + 20 + adventurer->level * 30, float(adventurer->level) * 2.5f, 0.0f, 1.0f});
+                getSession(this).adventurer_results.push_back({AdventurerResult::Death, adventurer->level, adventurer->loot + 20 + adventurer->level * 30, float(adventurer->level) * 2.5f, 0.0f, 1.0f});
             }
         }
     }
@@ -204,7 +279,27 @@ public:
         body.destroy();
     }
 
+    virtual const char* getAction() override
+    {
+        return "FIRE";
+    }
+
+    //Bit 0: armed, bit 1: a body lies in the trap.
+    virtual int getState() override
+    {
+        return (active ? 1 : 0) | (body ? 2 : 0);
+    }
+
+    virtual void setState(int state) override
+    {
+        active = state & 1;
+    }
+
 private:
     bool active = true;
     sp::P<sp::Node> body;
+
+    static constexpr int max_fire_effects = 100;
+
+    AllocationTag<FireTrap> allocation_tag{"FireTrap"};
 };
@@ -0,0 +1,28 @@
+#include <cstdint>
+
+//Layout of resources.pack, as written by tools/packResources.cpp and read by PackResourceProvider.
+//All values are little endian. The file starts with a PackHeader, followed by entry_count PackEntry records
+//sorted by name, followed by the name table and the file data. Data blocks are aligned to pack_data_alignment.
+static constexpr char pack_magic[4] = {'D', 'D', 'P', 'K'};
+static constexpr uint32_t pack_version = 1;
+static constexpr uint64_t pack_data_alignment = 16;
+
+struct PackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t name_table_size;
+};
+
+struct PackEntry
+{
+    uint64_t data_offset;
+    uint64_t data_size;
+    int64_t modify_time; //Seconds since epoch.
+    uint32_t name_offset; //Offset into the name table, which starts directly after the entries.
+    uint32_t name_length;
+};
+
+static_assert(sizeof(PackHeader) == 16, "PackHeader layout changed");
+static_assert(sizeof(PackEntry) == 32, "PackEntry layout changed");
@@ -0,0 +1,231 @@
+#include <sp2/io/resourceProvider.h>
+
+#include "packFormat.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Stream that reads directly from a block of memory owned by someone else.
+class MemoryResourceStream : public sp::io::ResourceStream
+{
+public:
+    MemoryResourceStream(const uint8_t* data, int64_t size)
+    : data(data), size(size)
+    {
+    }
+
+    virtual int64_t read(void* buffer, int64_t read_size) override
+    {
+        read_size = std::min(read_size, size - position);
+        memcpy(buffer, data + position, read_size);
+        position += read_size;
+        return read_size;
+    }
+
+    virtual int64_t seek(int64_t new_position) override
+    {
+        position = std::max(int64_t(0), std::min(new_position, size));
+        return position;
+    }
+
+    virtual int64_t tell() override
+    {
+        return position;
+    }
+
+    virtual int64_t getSize() override
+    {
+        return size;
+    }
+
+private:
+    const uint8_t* data;
+    int64_t size;
+    int64_t position = 0;
+};
+
+//Serves resources from a resources.pack archive (see tools/packResources.cpp).
+//The archive is memory mapped and the sorted index is searched in place, so opening a resource does not touch the filesystem.
+class PackResourceProvider : public sp::io::ResourceProvider
+{
+public:
+    PackResourceProvider(const sp::string& filename)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER file_size;
+        if (GetFileSizeEx(file, &file_size))
+        {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+            {
+                data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                size = file_size.QuadPart;
+                if (!data)
+                {
+                    CloseHandle(mapping);
+                    mapping = nullptr;
+                }
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED)
+            {
+                data = static_cast<const uint8_t*>(ptr);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+#endif
+        if (!data)
+            return;
+        if (size < int64_t(sizeof(PackHeader)))
+        {
+            unmap();
+            return;
+        }
+        header = reinterpret_cast<const PackHeader*>(data);
+        if (memcmp(header->magic, pack_magic, sizeof(pack_magic)) != 0 || header->version != pack_version
+            || sizeof(PackHeader) + sizeof(PackEntry) * uint64_t(header->entry_count) + header->name_table_size > uint64_t(size))
+        {
+            LOG(Warning, "Invalid resource pack:", filename);
+            unmap();
+            return;
+        }
+        entries = reinterpret_cast<const PackEntry*>(data + sizeof(PackHeader));
+        names = reinterpret_cast<const char*>(entries + header->entry_count);
+        if (!validateEntries())
+        {
+            LOG(Warning, "Corrupt resource pack:", filename);
+            unmap();
+        }
+    }
+
+    virtual ~PackResourceProvider()
+    {
+        unmap();
+    }
+
+    bool isValid()
+    {
+        return header != nullptr;
+    }
+
+    virtual sp::io::ResourceStreamPtr getStream(const sp::string filename) override
+    {
+        const PackEntry* entry = find(filename);
+        if (!entry)
+            return nullptr;
+        return std::make_shared<MemoryResourceStream>(data + entry->data_offset, entry->data_size);
+    }
+
+    virtual std::chrono::system_clock::time_point getFileModifyTime(const sp::string filename) override
+    {
+        const PackEntry* entry = find(filename);
+        if (!entry)
+            return std::chrono::system_clock::time_point();
+        return std::chrono::system_clock::time_point(std::chrono::seconds(entry->modify_time));
+    }
+
+    virtual void findResources(std::vector<sp::string>& found_files, const sp::string search_pattern) override
+    {
+        if (!header)
+            return;
+        for(uint32_t n=0; n<header->entry_count; n++)
+        {
+            sp::string name(names + entries[n].name_offset, entries[n].name_length);
+            if (searchMatch(name, search_pattern))
+                found_files.push_back(name);
+        }
+    }
+
+private:
+    const PackEntry* find(const sp::string& filename)
+    {
+        if (!header)
+            return nullptr;
+        const PackEntry* end = entries + header->entry_count;
+        const PackEntry* entry = std::lower_bound(entries, end, filename, [this](const PackEntry& e, const sp::string& name)
+        {
+            return compareName(e, name) < 0;
+        });
+        if (entry == end || compareName(*entry, filename) != 0)
+            return nullptr;
+        return entry;
+    }
+
+    //Check every entry once, so lookups can trust the offsets: names and data inside the file, and names sorted for the binary search.
+    bool validateEntries()
+    {
+        for(uint32_t n=0; n<header->entry_count; n++)
+        {
+            const PackEntry& entry = entries[n];
+            if (uint64_t(entry.name_offset) + entry.name_length > header->name_table_size)
+                return false;
+            if (entry.data_offset > uint64_t(size) || entry.data_size > uint64_t(size) - entry.data_offset)
+                return false;
+            if (n > 0 && compareName(entries[n - 1], sp::string(names + entry.name_offset, entry.name_length)) >= 0)
+                return false;
+        }
+        return true;
+    }
+
+    int compareName(const PackEntry& entry, const sp::string& name)
+    {
+        int result = memcmp(names + entry.name_offset, name.data(), std::min(size_t(entry.name_length), name.size()));
+        if (result != 0)
+            return result;
+        if (entry.name_length < name.size())
+            return -1;
+        if (entry.name_length > name.size())
+            return 1;
+        return 0;
+    }
+
+    void unmap()
+    {
+        if (data)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+            CloseHandle(mapping);
+            mapping = nullptr;
+#else
+            munmap(const_cast<uint8_t*>(data), size);
+#endif
+        }
+        data = nullptr;
+        size = 0;
+        header = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+    const uint8_t* data = nullptr;
+    int64_t size = 0;
+    const PackHeader* header = nullptr;
+    const PackEntry* entries = nullptr;
+    const char* names = nullptr;
+};
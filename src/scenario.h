@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+//A room of a scenario that is build, at a grid position of DungeonSnapshot. The entrance at 0, 0 is always build.
+struct ScenarioRoom
+{
+    int x;
+    int y;
+    sp::string object; //Build action of the object in the room, empty for none.
+    int state; //DungeonObject::setState() value, 0 keeps the state the object is created with.
+};
+
+//A reproducible headless game: dungeon, economy, spawn parameters, seed and number of days. Stored as a text file:
+//  # comment
+//  seed: 1234
+//  days: 2
+//  money: 30
+//  risk: 0.5
+//  reward: 1.5
+//  deception: 0
+//  bodies: 0
+//  spawn_count: 0        (0: follows from risk and reward, as in the game)
+//  max_level: 0          (0: follows from reward)
+//  spawn_delay: 80 140
+//  room: 1 0
+//  room: 2 0 FIRE
+//  room: 2 1 BODY 3
+//Every build room is listed once, the entrance is implied. Rooms are dug in order of distance from the entrance with the normal DIG action,
+//so every room must connect to the entrance through other build rooms.
+class Scenario
+{
+public:
+    bool load(const sp::string& filename)
+    {
+        std::ifstream file(filename);
+        if (!file)
+        {
+            LOG(Error, "Failed to open scenario", filename);
+            return false;
+        }
+        *this = Scenario();
+        name = filename;
+        std::string line;
+        int line_number = 0;
+        while(std::getline(file, line))
+        {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                if (line.find_first_not_of(" \t\r") != std::string::npos)
+                    LOG(Warning, filename, "line", line_number, "ignored:", line);
+                continue;
+            }
+            std::string key = line.substr(0, colon);
+            key.erase(0, key.find_first_not_of(" \t"));
+            key.erase(key.find_last_not_of(" \t") + 1);
+            std::istringstream value(line.substr(colon + 1));
+            if (key == "seed")
+                value >> seed;
+            else if (key == "days")
+                value >> days;
+            else if (key == "money")
+                value >> money;
+            else if (key == "risk")
+                value >> risk;
+            else if (key == "reward")
+                value >> reward;
+            else if (key == "deception")
+                value >> dragon_deception;
+            else if (key == "bodies")
+                value >> placable_bodies;
+            else if (key == "spawn_count")
+                value >> spawn_count;
+            else if (key == "max_level")
+                value >> max_level;
+            else if (key == "spawn_delay")
+                value >> spawn_delay_min >> spawn_delay_max;
+            else if (key == "room")
+            {
+                ScenarioRoom room{0, 0, "", 0};
+                std::string object;
+                value >> room.x >> room.y;
+                if (value >> object)
+                    room.object = object;
+                value >> room.state;
+                rooms.push_back(room);
+            }
+            else
+            {
+                LOG(Warning, filename, "line", line_number, "unknown key:", key);
+            }
+        }
+        return true;
+    }
+
+    bool save(const sp::string& filename, const std::vector<sp::string>& comments=std::vector<sp::string>())
+    {
+        std::ofstream file(filename);
+        if (!file)
+        {
+            LOG(Error, "Failed to write scenario", filename);
+            return false;
+        }
+        for(auto& comment : comments)
+            file << "# " << comment << "\n";
+        file << "seed: " << seed << "\n";
+        file << "days: " << days << "\n";
+        file << "money: " << money << "\n";
+        file << "risk: " << risk << "\n";
+        file << "reward: " << reward << "\n";
+        file << "deception: " << dragon_deception << "\n";
+        file << "bodies: " << placable_bodies << "\n";
+        file << "spawn_count: " << spawn_count << "\n";
+        file << "max_level: " << max_level << "\n";
+        file << "spawn_delay: " << spawn_delay_min << " " << spawn_delay_max << "\n";
+        for(auto& room : rooms)
+        {
+            file << "room: " << room.x << " " << room.y;
+            if (!room.object.empty())
+                file << " " << room.object;
+            if (room.state)
+                file << " " << room.state;
+            file << "\n";
+        }
+        return bool(file);
+    }
+
+    //Build the scenario in a fresh scene, through the normal build actions.
+    void apply(sp::P<DungeonScene> scene) const
+    {
+        GameSession& session = scene->session;
+        session.money = std::numeric_limits<int>::max() / 2;
+
+        //Dig outwards from the entrance, so every room is next to a build room when it is dug.
+        std::map<std::pair<int, int>, const ScenarioRoom*> todo;
+        for(auto& room : rooms)
+            todo[{room.x, room.y}] = &room;
+        std::vector<const ScenarioRoom*> build_order;
+        std::vector<std::pair<int, int>> open{{0, 0}};
+        std::set<std::pair<int, int>> reached{{0, 0}};
+        for(size_t n=0; n<open.size(); n++)
+        {
+            for(auto offset : {std::make_pair(1, 0), std::make_pair(-1, 0), std::make_pair(0, 1), std::make_pair(0, -1)})
+            {
+                std::pair<int, int> next{open[n].first + offset.first, open[n].second + offset.second};
+                auto it = todo.find(next);
+                //Nothing can be build left of the entrance.
+                if (next.first < 0 || it == todo.end() || !reached.insert(next).second)
+                    continue;
+                open.push_back(next);
+                build_order.push_back(it->second);
+            }
+        }
+        int unreachable = todo.size() - build_order.size() - todo.count({0, 0});
+        if (unreachable > 0)
+            LOG(Warning, "Scenario", name, "has", unreachable, "rooms that do not connect to the entrance");
+
+        for(auto room : build_order)
+            scene->doAction("DIG", getRoomAt(scene, DungeonSnapshot::worldPosition(room->x, room->y), true));
+        for(auto& room : rooms)
+        {
+            if (room.object.empty())
+                continue;
+            sp::P<DungeonRoom> node = getRoomAt(scene, DungeonSnapshot::worldPosition(room.x, room.y));
+            if (!node)
+                continue;
+            scene->doAction(room.object, node);
+            if (node->main_object && room.state)
+                node->main_object->setState(room.state);
+        }
+
+        session.money = money;
+        session.risk = risk;
+        session.reward = reward;
+        session.dragon_deception = dragon_deception;
+        session.placable_bodies = placable_bodies;
+        session.forced_spawn_count = spawn_count;
+        session.forced_max_level = max_level;
+        session.spawn_delay_min = spawn_delay_min;
+        session.spawn_delay_max = std::max(spawn_delay_min, spawn_delay_max);
+        scene->updateSnapshot();
+    }
+
+    sp::string name;
+    uint32_t seed = 0;
+    int days = 1;
+    int money = 30;
+    float risk = 0.0f;
+    float reward = 0.0f;
+    float dragon_deception = 0.0f;
+    int placable_bodies = 0;
+    int spawn_count = 0;
+    int max_level = 0;
+    int spawn_delay_min = 80;
+    int spawn_delay_max = 140;
+    std::vector<ScenarioRoom> rooms;
+};
+
+struct ScenarioResult
+{
+    int days = 0;
+    int ticks = 0;
+    bool finished = true; //False when a day ran into SessionHost::max_ticks_per_day.
+    //Phases: creating the scene, building the dungeon, every day, and tearing the scene down.
+    double setup_seconds = 0.0;
+    double build_seconds = 0.0;
+    std::vector<double> day_seconds;
+    double end_of_day_seconds = 0.0; //Part of day_seconds, the fixed updates that ended a day.
+    double teardown_seconds = 0.0;
+    double total_seconds = 0.0;
+    double mean_tick = 0.0;
+    double p99_tick = 0.0;
+    double max_tick = 0.0;
+    int64_t allocations = 0; //Tracked objects created, see AllocationTracker.
+    int64_t max_tick_allocations = 0;
+    int64_t peak_bytes = 0; //Highest live bytes of tracked objects after any fixed update.
+    //Highest resident memory of the process during the run, including what was loaded before it. 0 when it can not be measured per run.
+    int64_t peak_resident_bytes = 0;
+
+    double getDaysSeconds() const
+    {
+        double total = 0.0;
+        for(auto seconds : day_seconds)
+            total += seconds;
+        return total;
+    }
+};
+
+//Plays a scenario headless and measures every fixed update. Scenarios are run one at a time,
+//as the allocation counts are process wide, and other threads would disturb the timings.
+class ScenarioRunner
+{
+public:
+    static ScenarioResult run(const Scenario& scenario)
+    {
+        ScenarioResult result;
+        AllocationTracker& tracker = AllocationTracker::get();
+        auto start = std::chrono::steady_clock::now();
+        int64_t allocations_start = tracker.getTotalCreated();
+        bool peak_reset = resetPeakResidentBytes();
+        sp::P<DungeonScene> scene = new DungeonScene("SCENARIO", scenario.seed, true);
+        result.setup_seconds = secondsSince(start);
+        auto build_start = std::chrono::steady_clock::now();
+        scenario.apply(scene);
+        result.build_seconds = secondsSince(build_start);
+
+        std::vector<double> tick_times;
+        int64_t allocations_before = tracker.getTotalCreated();
+        result.peak_bytes = tracker.getLiveBytes();
+        for(int day=0; day<scenario.days && result.finished; day++)
+        {
+            auto day_start = std::chrono::steady_clock::now();
+            scene->startDay();
+            for(int tick=0; tick<SessionHost::max_ticks_per_day && scene->isDayRunning(); tick++)
+            {
+                auto tick_start = std::chrono::steady_clock::now();
+                fixedUpdateScene(scene);
+                tick_times.push_back(secondsSince(tick_start));
+                if (!scene->isDayRunning())
+                    result.end_of_day_seconds += tick_times.back();
+
+                int64_t allocations_after = tracker.getTotalCreated();
+                result.max_tick_allocations = std::max(result.max_tick_allocations, allocations_after - allocations_before);
+                allocations_before = allocations_after;
+                result.peak_bytes = std::max(result.peak_bytes, tracker.getLiveBytes());
+            }
+            result.day_seconds.push_back(secondsSince(day_start));
+            result.finished = !scene->isDayRunning();
+            result.days++;
+        }
+        auto teardown_start = std::chrono::steady_clock::now();
+        scene.destroy();
+        result.teardown_seconds = secondsSince(teardown_start);
+
+        result.ticks = tick_times.size();
+        result.allocations = tracker.getTotalCreated() - allocations_start;
+        result.total_seconds = secondsSince(start);
+        if (peak_reset)
+            result.peak_resident_bytes = getPeakResidentBytes();
+        if (!tick_times.empty())
+        {
+            double total = 0.0;
+            for(auto t : tick_times)
+                total += t;
+            result.mean_tick = total / tick_times.size();
+            result.max_tick = *std::max_element(tick_times.begin(), tick_times.end());
+            size_t p99_index = std::min(tick_times.size() - 1, tick_times.size() * 99 / 100);
+            std::nth_element(tick_times.begin(), tick_times.begin() + p99_index, tick_times.end());
+            result.p99_tick = tick_times[p99_index];
+        }
+        return result;
+    }
+
+    //Run a scenario a number of times, and return the run that is in the middle by the given metric.
+    //A single run is easily disturbed by the rest of the machine.
+    static ScenarioResult runMedian(const Scenario& scenario, int runs, std::function<double(const ScenarioResult&)> metric)
+    {
+        std::vector<ScenarioResult> results;
+        for(int n=0; n<std::max(1, runs); n++)
+            results.push_back(run(scenario));
+        std::sort(results.begin(), results.end(), [&metric](const ScenarioResult& a, const ScenarioResult& b) { return metric(a) < metric(b); });
+        return results[results.size() / 2];
+    }
+
+    static std::vector<sp::string> describe(const ScenarioResult& result)
+    {
+        std::vector<sp::string> lines;
+        sp::string phases = "setup " + milliseconds(result.setup_seconds) + ", build " + milliseconds(result.build_seconds);
+        for(size_t n=0; n<result.day_seconds.size(); n++)
+            phases += ", day " + sp::string(int(n + 1)) + " " + milliseconds(result.day_seconds[n]);
+        phases += ", end of day " + milliseconds(result.end_of_day_seconds) + ", teardown " + milliseconds(result.teardown_seconds);
+        lines.push_back(phases);
+        lines.push_back(sp::string(result.days) + " days" + (result.finished ? "" : " (did not finish)") + ", " + sp::string(result.ticks) + " ticks, mean "
+            + milliseconds(result.mean_tick) + ", p99 " + milliseconds(result.p99_tick) + ", max " + milliseconds(result.max_tick));
+        lines.push_back(sp::string(int(result.allocations)) + " allocations, at most " + sp::string(int(result.max_tick_allocations))
+            + " in a tick, peak " + sp::string(int(result.peak_bytes / 1024)) + "KiB tracked, "
+            + (result.peak_resident_bytes ? sp::string(int(result.peak_resident_bytes / 1024)) + "KiB resident" : sp::string("resident unknown")));
+        return lines;
+    }
+
+    //Start a new peak for getPeakResidentBytes(). Only Linux can reset it, returns false when the peak is still that of the whole process.
+    static bool resetPeakResidentBytes()
+    {
+#ifdef __linux__
+        std::ofstream file("/proc/self/clear_refs");
+        file << "5";
+        file.flush();
+        return bool(file);
+#else
+        return false;
+#endif
+    }
+
+    //Highest resident memory since the last resetPeakResidentBytes(), or of the whole process so far. 0 when unknown.
+    static int64_t getPeakResidentBytes()
+    {
+#ifdef __linux__
+        std::ifstream file("/proc/self/status");
+        std::string line;
+        while(std::getline(file, line))
+        {
+            if (line.compare(0, 6, "VmHWM:") != 0)
+                continue;
+            int64_t kib = 0;
+            std::istringstream value(line.substr(6));
+            value >> kib;
+            return kib * 1024;
+        }
+        return 0;
+#elif defined(_WIN32)
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        return int64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+private:
+    static double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static sp::string milliseconds(double seconds)
+    {
+        return sp::string(seconds * 1000.0, 3) + "ms";
+    }
+};
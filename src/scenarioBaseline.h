@@ -0,0 +1,142 @@
+//Recorded results of a scenario, to compare new runs against. Stored next to the scenario, maze.scenario has maze.baseline:
+//  # comment
+//  mean_tick: 0.000152 0.25
+//  allocations: 5230 0.05
+//Every line is a metric, its recorded value and its tolerance: the relative increase that still passes.
+//All metrics are costs, so only increases fail. Timings only compare on the machine that recorded them.
+class ScenarioBaseline
+{
+public:
+    struct Metric
+    {
+        sp::string name;
+        double value;
+        double tolerance;
+    };
+
+    //The metrics of a result, with their default tolerances. Tick counts and allocations follow from the seed, timings are noisy,
+    //and the single slowest tick most of all.
+    static std::vector<Metric> getMetrics(const ScenarioResult& result)
+    {
+        return {
+            {"ticks", double(result.ticks), 0.05},
+            {"build_seconds", result.build_seconds, 0.5},
+            {"day_seconds", result.getDaysSeconds(), 0.25},
+            {"end_of_day_seconds", result.end_of_day_seconds, 0.5},
+            {"mean_tick", result.mean_tick, 0.25},
+            {"p99_tick", result.p99_tick, 0.5},
+            {"max_tick", result.max_tick, 1.0},
+            {"allocations", double(result.allocations), 0.05},
+            {"peak_bytes", double(result.peak_bytes), 0.1},
+            {"peak_resident_bytes", double(result.peak_resident_bytes), 0.1},
+        };
+    }
+
+    static sp::string getFilename(const sp::string& scenario_filename)
+    {
+        const sp::string extension = ".scenario";
+        if (scenario_filename.size() > extension.size() && scenario_filename.compare(scenario_filename.size() - extension.size(), extension.size(), extension) == 0)
+            return scenario_filename.substr(0, scenario_filename.size() - extension.size()) + ".baseline";
+        return scenario_filename + ".baseline";
+    }
+
+    //Returns false when there is no baseline.
+    bool load(const sp::string& filename)
+    {
+        metrics.clear();
+        std::ifstream file(filename);
+        if (!file)
+            return false;
+        std::string line;
+        while(std::getline(file, line))
+        {
+            line = line.substr(0, line.find('#'));
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+                continue;
+            std::string name = line.substr(0, colon);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            Metric metric{name, 0.0, 0.0};
+            std::istringstream value(line.substr(colon + 1));
+            if (value >> metric.value)
+            {
+                value >> metric.tolerance;
+                metrics.push_back(metric);
+            }
+            else
+            {
+                LOG(Warning, filename, "has no value for", name);
+            }
+        }
+        return true;
+    }
+
+    bool save(const sp::string& filename, const std::vector<sp::string>& comments=std::vector<sp::string>())
+    {
+        std::ofstream file(filename);
+        if (!file)
+        {
+            LOG(Error, "Failed to write baseline", filename);
+            return false;
+        }
+        for(auto& comment : comments)
+            file << "# " << comment << "\n";
+        file.precision(9);
+        for(auto& metric : metrics)
+            file << metric.name << ": " << metric.value << " " << metric.tolerance << "\n";
+        return bool(file);
+    }
+
+    //Replace the values with those of result. Tolerances that were already set are kept.
+    void record(const ScenarioResult& result)
+    {
+        std::vector<Metric> recorded = getMetrics(result);
+        for(auto& metric : recorded)
+        {
+            const Metric* old = find(metric.name);
+            if (old)
+                metric.tolerance = old->tolerance;
+        }
+        metrics = recorded;
+    }
+
+    //Logs every metric that is in the baseline. Returns false when any of them grew by more than its tolerance times tolerance_scale.
+    bool compare(const sp::string& name, const ScenarioResult& result, double tolerance_scale) const
+    {
+        bool ok = true;
+        for(auto& metric : getMetrics(result))
+        {
+            const Metric* baseline = find(metric.name);
+            if (!baseline)
+                continue;
+            double limit = baseline->value * (1.0 + baseline->tolerance * tolerance_scale);
+            double change = baseline->value > 0.0 ? (metric.value / baseline->value - 1.0) * 100.0 : 0.0;
+            sp::string line = metric.name + ": " + sp::string(metric.value, 6) + ", baseline " + sp::string(baseline->value, 6)
+                + " (" + (change >= 0.0 ? "+" : "") + sp::string(change, 1) + "%)";
+            if (metric.value > limit)
+            {
+                LOG(Error, name, "regression", line);
+                ok = false;
+            }
+            else
+            {
+                LOG(Info, name, line);
+            }
+        }
+        return ok;
+    }
+
+    std::vector<Metric> metrics;
+
+private:
+    const Metric* find(const sp::string& name) const
+    {
+        for(auto& metric : metrics)
+        {
+            if (metric.name == name)
+                return &metric;
+        }
+        return nullptr;
+    }
+};
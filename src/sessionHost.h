@@ -0,0 +1,264 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+struct SessionReport
+{
+    uint32_t seed;
+    int days;
+    int ticks;
+    int rooms;
+    int money;
+    float risk;
+    float reward;
+    float dragon_deception;
+    int deaths;
+    int fled;
+    int escaped;
+    double seconds;
+    std::vector<sp::string> allocation_growth;
+    std::vector<sp::string> allocation_days; //AllocationScope::getDayReport() of the session at the end of every day.
+    //Build state the session started its first day with.
+    DungeonSnapshot snapshot;
+};
+
+//Build action on the room at a grid position.
+struct BranchAction
+{
+    sp::string action;
+    int x;
+    int y;
+};
+
+//A what-if branch: build actions on top of a snapshot. The snapshot is shared, so making many branches of the same dungeon is cheap.
+struct DungeonBranch
+{
+    DungeonSnapshot base;
+    std::vector<BranchAction> actions;
+};
+
+//Run a single fixed update for a scene that is not driven by the engine.
+void fixedUpdateNode(sp::P<sp::Node> node)
+{
+    node->onFixedUpdate();
+    if (!node)
+        return;
+    for(sp::P<sp::Node> child : node->getChildren())
+    {
+        if (child)
+            fixedUpdateNode(child);
+    }
+}
+
+void fixedUpdateScene(sp::P<sp::Scene> scene)
+{
+    scene->onFixedUpdate();
+    fixedUpdateNode(scene->getRoot());
+}
+
+//Build policy for headless sessions. Spends money on random rooms, so days are not all played against an empty dungeon.
+void autoBuild(sp::P<DungeonScene> scene)
+{
+    static const char* traps[] = {"PIT", "LOOT", "FIRE", "SLIME"};
+    GameSession& session = scene->session;
+
+    std::vector<sp::P<DungeonRoom>> rooms;
+    for(sp::P<DungeonRoom> room : scene->getRoot()->getChildren())
+    {
+        if (room)
+            rooms.push_back(room);
+    }
+    for(int attempt=0; attempt<10; attempt++)
+    {
+        sp::P<DungeonRoom> room = rooms[session.irandom(0, rooms.size() - 1)];
+        sp::string action;
+        if (!room->build)
+            action = "DIG";
+        else if (!room->main_object)
+            action = traps[session.irandom(0, 3)];
+        else
+            continue;
+        if (session.money >= session.cost_map[action])
+            scene->doAction(action, room);
+    }
+}
+
+//A what-if branch of up to action_count random build actions on top of base: digs next to the dungeon and traps in empty rooms.
+//Actions the money does not cover are skipped when the branch is played.
+DungeonBranch randomBranch(const DungeonSnapshot& base, std::mt19937& random_engine, int action_count)
+{
+    static const char* traps[] = {"PIT", "LOOT", "FIRE", "SLIME"};
+    std::vector<const RoomState*> rooms;
+    base.rooms.forEach([&rooms](const RoomState& room) { rooms.push_back(&room); });
+
+    DungeonBranch branch{base, {}};
+    for(int attempt=0; attempt<action_count * 4 && int(branch.actions.size()) < action_count && !rooms.empty(); attempt++)
+    {
+        const RoomState& room = *rooms[std::uniform_int_distribution<int>(0, rooms.size() - 1)(random_engine)];
+        if (!room.build)
+            branch.actions.push_back({"DIG", room.x, room.y});
+        else if (room.object.empty())
+            branch.actions.push_back({traps[std::uniform_int_distribution<int>(0, 3)(random_engine)], room.x, room.y});
+    }
+    return branch;
+}
+
+//Runs many independent headless dungeon sessions on a fixed pool of worker threads.
+//A worker runs one session at a time to completion, so memory use is bounded by the number of workers, not the number of sessions.
+//Sessions share nothing but the SeriousProton scene registry, which is only touched when a session is created or destroyed.
+class SessionHost
+{
+public:
+    //Upper limit of fixed updates in a single day, so a stuck session can not hang its worker.
+    static constexpr int max_ticks_per_day = 60 * 60 * 10;
+
+    SessionHost(int thread_count)
+    : thread_count(std::max(1, thread_count))
+    {
+    }
+
+    //Check for unbounded memory growth. Sessions only build during the first half of their days, after that
+    //the dungeon is fixed, and a class whose live count at the end of the day rises on every one of those days is reported.
+    //Every session counts its own objects in an AllocationScope, so this works with any number of threads.
+    void setCheckAllocations(bool enable)
+    {
+        check_allocations = enable;
+    }
+
+    std::vector<SessionReport> run(int session_count, int days, uint32_t seed)
+    {
+        return runPool(session_count, [this, seed, days](int index)
+        {
+            return runSession(index, seed + index, days, check_allocations);
+        });
+    }
+
+    //Simulate what-if branches side by side. All branches use the same seed, so they face the same adventurers,
+    //and nothing is built on top of them. Commit the chosen one with DungeonScene::restoreSnapshot(report.snapshot).
+    std::vector<SessionReport> runBranches(const std::vector<DungeonBranch>& branches, int days, uint32_t seed)
+    {
+        return runPool(branches.size(), [&branches, seed, days](int index)
+        {
+            return runSession(index, seed, days, false, &branches[index]);
+        });
+    }
+
+    static SessionReport runSession(int index, uint32_t seed, int days, bool check_allocations=false, const DungeonBranch* branch=nullptr)
+    {
+        std::vector<std::vector<std::pair<sp::string, int64_t>>> day_end_counts;
+        auto start = std::chrono::steady_clock::now();
+        //Everything the session creates runs on this thread, and counts for its own scope.
+        std::shared_ptr<AllocationScope> allocations = std::make_shared<AllocationScope>("Session " + sp::string(index) + " seed " + sp::string(int(seed)));
+        AllocationScope::Enter enter_allocations(allocations);
+        sp::P<DungeonScene> scene;
+        {
+            std::lock_guard<std::mutex> lock(scene_registry_mutex);
+            scene = new DungeonScene("SESSION_" + sp::string(index), seed, true);
+        }
+        if (branch)
+        {
+            scene->restoreSnapshot(branch->base);
+            for(auto& action : branch->actions)
+                scene->doAction(action.action, getRoomAt(scene, DungeonSnapshot::worldPosition(action.x, action.y), true));
+        }
+
+        SessionReport report;
+        report.snapshot = scene->getSnapshot();
+        int ticks = 0;
+        for(int day=0; day<days; day++)
+        {
+            bool frozen = check_allocations && day >= days / 2;
+            if (!frozen && !branch)
+                autoBuild(scene);
+            allocations->markDay();
+            scene->startDay();
+            for(int tick=0; tick<max_ticks_per_day && scene->isDayRunning(); tick++)
+            {
+                fixedUpdateScene(scene);
+                ticks++;
+            }
+            report.allocation_days.push_back("day " + sp::string(day + 1) + ", " + allocations->getDayReport());
+            if (scene->isDayRunning())
+            {
+                LOG(Warning, "Session", index, "did not finish day", day);
+                break;
+            }
+            if (frozen)
+                day_end_counts.push_back(allocations->getLiveCounts());
+        }
+
+        GameSession& session = scene->session;
+        report.seed = seed;
+        report.days = session.day;
+        report.ticks = ticks;
+        report.rooms = 0;
+        for(sp::P<DungeonRoom> room : scene->getRoot()->getChildren())
+        {
+            if (room && room->build)
+                report.rooms++;
+        }
+        report.money = session.money;
+        report.risk = session.risk;
+        report.reward = session.reward;
+        report.dragon_deception = session.dragon_deception;
+        report.deaths = session.deaths;
+        report.fled = session.fled;
+        report.escaped = session.escaped;
+        if (day_end_counts.size() >= 3)
+        {
+            for(size_t n=0; n<day_end_counts.back().size(); n++)
+            {
+                bool growing = true;
+                for(size_t day=1; day<day_end_counts.size(); day++)
+                {
+                    //Classes that are first seen later are missing from the earlier days, and start at zero.
+                    int64_t before = n < day_end_counts[day - 1].size() ? day_end_counts[day - 1][n].second : 0;
+                    int64_t after = n < day_end_counts[day].size() ? day_end_counts[day][n].second : 0;
+                    if (after <= before)
+                        growing = false;
+                }
+                if (growing)
+                    report.allocation_growth.push_back(day_end_counts.back()[n].first + " grew every day to " + sp::string(int(day_end_counts.back()[n].second)));
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(scene_registry_mutex);
+            scene.destroy();
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+private:
+    //Run count jobs on the worker threads, a worker takes the next job as soon as it finished the previous one.
+    template<typename F> std::vector<SessionReport> runPool(int count, F job)
+    {
+        std::vector<SessionReport> reports(count);
+        std::atomic<int> next_index{0};
+        std::vector<std::thread> threads;
+        for(int n=0; n<std::min(thread_count, count); n++)
+        {
+            threads.emplace_back([&]()
+            {
+                while(true)
+                {
+                    int index = next_index++;
+                    if (index >= count)
+                        break;
+                    reports[index] = job(index);
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        return reports;
+    }
+
+    int thread_count;
+    bool check_allocations = false;
+
+    static std::mutex scene_registry_mutex;
+};
+
+std::mutex SessionHost::scene_registry_mutex;
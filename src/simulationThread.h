@@ -0,0 +1,287 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+//Everything the render thread needs of a single simulation tick. Only written by the simulation thread while it owns the buffer.
+struct RenderSnapshot
+{
+    struct Entity
+    {
+        uintptr_t id;
+        sp::Vector2d position;
+        double rotation;
+        sp::RenderData render_data;
+    };
+
+    uint64_t tick = 0;
+    std::vector<Entity> entities;
+    DungeonUIModel ui;
+};
+
+//Lock free triple buffer with a single writer and a single reader.
+//The writer always has a buffer to fill and the reader always has the latest complete one, neither ever waits for the other.
+//Buffers are reused, so once their vectors have grown publishing does not allocate.
+template<typename T> class TripleBuffer
+{
+public:
+    T& getWriteBuffer()
+    {
+        return buffers[write_index];
+    }
+
+    //Hand the write buffer to the reader, and continue with the oldest one.
+    void publish()
+    {
+        write_index = middle.exchange(write_index | fresh_flag) & index_mask;
+    }
+
+    //The latest published buffer. Stays valid and unchanged until the next call.
+    const T& getReadBuffer()
+    {
+        if (middle.load() & fresh_flag)
+            read_index = middle.exchange(read_index) & index_mask;
+        return buffers[read_index];
+    }
+
+private:
+    static constexpr int index_mask = 3;
+    static constexpr int fresh_flag = 4;
+
+    T buffers[3];
+    int write_index = 0;
+    std::atomic<int> middle{1};
+    int read_index = 2;
+};
+
+//Run the variable rate update of a scene that is not driven by the engine.
+void updateNode(sp::P<sp::Node> node, float delta)
+{
+    node->onUpdate(delta);
+    if (!node)
+        return;
+    for(sp::P<sp::Node> child : node->getChildren())
+    {
+        if (child)
+            updateNode(child, delta);
+    }
+}
+
+//Runs a headless DungeonScene on its own thread at a fixed tick rate.
+//After every tick the positions, render data and UI model of the dungeon are copied into a TripleBuffer, which the render thread reads without locking.
+//Input goes the other way as commands, which run on the simulation thread at the start of the next tick.
+class SimulationThread
+{
+public:
+    static constexpr double tick_length = 1.0 / 60.0;
+
+    SimulationThread(uint32_t seed, const sp::string& export_name)
+    {
+        scene = new DungeonScene("SIMULATION", seed, true);
+        if (!export_name.empty())
+            scene->exportState(export_name);
+        cost_map = scene->session.cost_map;
+        publish();
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~SimulationThread()
+    {
+        stop_requested = true;
+        thread.join();
+        scene.destroy();
+    }
+
+    void post(std::function<void(DungeonScene&)> command)
+    {
+        std::lock_guard<std::mutex> lock(command_mutex);
+        commands.push_back(std::move(command));
+    }
+
+    const RenderSnapshot& getSnapshot()
+    {
+        return snapshots.getReadBuffer();
+    }
+
+    const std::unordered_map<sp::string, int>& getCostMap()
+    {
+        return cost_map;
+    }
+
+private:
+    void run()
+    {
+        auto tick_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(tick_length));
+        auto next_tick = std::chrono::steady_clock::now();
+        std::vector<std::function<void(DungeonScene&)>> pending;
+        while(!stop_requested)
+        {
+            {
+                std::lock_guard<std::mutex> lock(command_mutex);
+                pending.swap(commands);
+            }
+            for(auto& command : pending)
+                command(**scene);
+            pending.clear();
+
+            //The scene is headless and does not report its own tick cost, so the effect budget gets it from here.
+            auto tick_start = std::chrono::steady_clock::now();
+            fixedUpdateScene(scene);
+            effect_budget.addTick(std::chrono::duration<float>(std::chrono::steady_clock::now() - tick_start).count());
+            scene->onUpdate(tick_length);
+            updateNode(scene->getRoot(), tick_length);
+            publish();
+
+            //After a stall, continue from now instead of running a burst of ticks to catch up.
+            next_tick += tick_duration;
+            auto now = std::chrono::steady_clock::now();
+            if (next_tick < now - tick_duration * 10)
+                next_tick = now;
+            std::this_thread::sleep_until(next_tick);
+        }
+    }
+
+    void publish()
+    {
+        RenderSnapshot& snapshot = snapshots.getWriteBuffer();
+        snapshot.tick = scene->session.timers.getTick();
+        snapshot.entities.clear();
+        addEntities(snapshot, scene->getRoot(), sp::Vector2d(0, 0));
+        scene->fillUIModel(snapshot.ui);
+        snapshots.publish();
+    }
+
+    void addEntities(RenderSnapshot& snapshot, sp::P<sp::Node> node, sp::Vector2d offset)
+    {
+        for(sp::P<sp::Node> child : node->getChildren())
+        {
+            if (!child)
+                continue;
+            sp::Vector2d position = offset + child->getPosition2D();
+            if (child->render_data.type != sp::RenderData::Type::None)
+                snapshot.entities.push_back({uintptr_t(*child), position, child->getRotation2D(), child->render_data});
+            addEntities(snapshot, child, position);
+        }
+    }
+
+    sp::P<DungeonScene> scene;
+    std::unordered_map<sp::string, int> cost_map;
+    TripleBuffer<RenderSnapshot> snapshots;
+
+    std::mutex command_mutex;
+    std::vector<std::function<void(DungeonScene&)>> commands;
+
+    std::atomic<bool> stop_requested{false};
+    std::thread thread;
+};
+
+//The scene the engine renders when the simulation runs on its own thread.
+//Holds a plain node for every visible node of the simulation, and the GUI, and updates both from the latest snapshot.
+class DungeonView : public sp::Scene, public DungeonCommands
+{
+public:
+    DungeonView(const sp::string& name, uint32_t seed, const sp::string& export_name="")
+    : sp::Scene(name), simulation(seed, export_name)
+    {
+        createDungeonCamera(this);
+        ui.reset(new DungeonUI(this, *this, simulation.getCostMap()));
+    }
+
+    virtual void selectRoom(sp::Vector2d position) override
+    {
+        simulation.post([position](DungeonScene& scene) { scene.selectRoom(position); });
+    }
+
+    virtual void startDay() override
+    {
+        simulation.post([](DungeonScene& scene) { scene.startDay(); });
+    }
+
+    virtual void buildAction(const sp::string& action) override
+    {
+        simulation.post([action](DungeonScene& scene) { scene.buildAction(action); });
+    }
+
+    virtual void undo() override
+    {
+        simulation.post([](DungeonScene& scene) { scene.undo(); });
+    }
+
+    virtual bool onPointerDown(sp::io::Pointer::Button button, sp::Ray3d ray, int id) override
+    {
+        return true;
+    }
+
+    virtual void onPointerDrag(sp::Ray3d ray, int id) override
+    {
+    }
+
+    virtual void onPointerUp(sp::Ray3d ray, int id) override
+    {
+        if (simulation.getSnapshot().ui.day_running)
+            return;
+
+        selectRoom(sp::Vector2d(ray.start.x, ray.start.y));
+        ui->clearAction();
+    }
+
+    virtual void onTextInput(const sp::string& text) override
+    {
+    }
+
+    virtual void onUpdate(float delta) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        const RenderSnapshot& snapshot = simulation.getSnapshot();
+        if (snapshot.tick != shown_tick)
+        {
+            shown_tick = snapshot.tick;
+            applySnapshot(snapshot);
+            ui->markDirty();
+        }
+        ui->update(delta, snapshot.ui);
+        effect_budget.addFrame(delta, std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    struct Proxy
+    {
+        sp::P<sp::Node> node;
+        uint64_t generation;
+    };
+
+    void applySnapshot(const RenderSnapshot& snapshot)
+    {
+        generation++;
+        for(auto& entity : snapshot.entities)
+        {
+            Proxy& proxy = proxies[entity.id];
+            if (!proxy.node)
+                proxy.node = new sp::Node(getRoot());
+            proxy.node->render_data = entity.render_data;
+            proxy.node->setPosition(entity.position);
+            proxy.node->setRotation(entity.rotation);
+            proxy.generation = generation;
+        }
+        for(auto it = proxies.begin(); it != proxies.end(); )
+        {
+            if (it->second.generation != generation)
+            {
+                it->second.node.destroy();
+                it = proxies.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    SimulationThread simulation;
+    std::unique_ptr<DungeonUI> ui;
+    std::unordered_map<uintptr_t, Proxy> proxies;
+    uint64_t generation = 0;
+    uint64_t shown_tick = std::numeric_limits<uint64_t>::max();
+};
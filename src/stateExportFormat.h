@@ -0,0 +1,236 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+//Layout of the shared memory block written by StateExporter (src/stateExporter.h) and read by tools/stateReader.cpp.
+//The block is a POSIX shared memory object, /dragon_deception by default. All values are native endian.
+//
+//It starts with a StateExportHeader, followed by slot_count StateExportSlot records, the ring buffer.
+//Every fixed update, frame number N (counting from 0) is written into slot N % slot_count, under the seqlock of that slot:
+//  sequence = 2N+1 (odd while writing), write the frame, sequence = 2N+2, then header frame_count = N+1.
+//The writer never waits for readers. To read the latest frame without copying it:
+//  1. N = frame_count - 1, the slot is N % slot_count. When frame_count is 0 nothing was written yet.
+//  2. Load sequence with acquire ordering, it must be 2N+2, otherwise the slot is being overwritten: start again.
+//  3. Read the fields that are needed in place.
+//  4. Acquire fence, load sequence again. If it changed, the values read in step 3 can be torn: throw them away and start again.
+//With slot_count slots a reader has slot_count-1 fixed updates to finish reading before its slot is reused.
+//readLatestStateExportFrame() at the end of this file implements these steps, with a back off and a timeout for a stalled writer.
+static constexpr char state_export_magic[4] = {'D', 'D', 'S', 'X'};
+static constexpr uint32_t state_export_version = 2;
+static constexpr const char* state_export_default_name = "/dragon_deception";
+static constexpr uint32_t state_export_slot_count = 8;
+//Well above the biggest dungeons: a room that is build has at most 4 neighbours that can be dug, and the fuzzer
+//builds up to 200 rooms and spawns up to 100 adventurers. About 32KiB per slot.
+static constexpr uint32_t state_export_max_rooms = 2048;
+static constexpr uint32_t state_export_max_adventurers = 256;
+
+//Values of StateExportRoom::trap.
+enum StateExportTrap : uint8_t
+{
+    state_export_trap_none = 0,
+    state_export_trap_pit = 1,
+    state_export_trap_loot = 2,
+    state_export_trap_fire = 3,
+    state_export_trap_slime = 4,
+    state_export_trap_body = 5,
+};
+
+//Bits of StateExportFrame::flags.
+static constexpr uint32_t state_export_flag_day_running = 1;
+static constexpr uint32_t state_export_flag_rooms_truncated = 2; //More than state_export_max_rooms rooms, some that are not build are missing.
+static constexpr uint32_t state_export_flag_adventurers_truncated = 4;
+
+struct StateExportHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size; //sizeof(StateExportHeader), the first slot starts here.
+    uint32_t slot_size; //sizeof(StateExportSlot)
+    uint32_t slot_count;
+    uint32_t max_rooms;
+    uint32_t max_adventurers;
+    uint32_t reserved;
+    std::atomic<uint64_t> frame_count; //Number of completely written frames.
+    uint64_t padding[3];
+};
+
+struct StateExportEconomy
+{
+    int32_t money;
+    float risk;
+    float reward;
+    float dragon_deception;
+    int32_t placable_bodies;
+    int32_t day; //Number of finished days.
+    int32_t deaths;
+    int32_t fled;
+    int32_t escaped;
+    int32_t reserved;
+};
+
+//Rooms are on a grid of 4 by 6 world units, the entrance is at 0, 0. Rooms that are not build yet are the places that can be dug next.
+struct StateExportRoom
+{
+    int16_t x;
+    int16_t y;
+    uint8_t build;
+    uint8_t entrance;
+    uint8_t trap; //StateExportTrap
+    uint8_t reserved;
+    //Pit and fire: bit 0 armed, bit 1 a body lies in the trap. Body and slime: days left before it decays. Loot: 0.
+    int32_t trap_state;
+};
+
+struct StateExportAdventurer
+{
+    uint32_t id; //Unique within a session, never reused.
+    int32_t level;
+    float x; //World position.
+    float y;
+    int32_t hp;
+    int32_t courage;
+    uint8_t fleeing;
+    uint8_t slimed;
+    uint8_t reserved[2];
+    int32_t loot;
+};
+
+struct StateExportFrame
+{
+    uint64_t tick; //Fixed update of the session this frame was taken at.
+    uint32_t seed; //Seed of the session, changes when a new game is started.
+    uint32_t flags;
+    uint32_t room_count;
+    uint32_t adventurer_count;
+    uint64_t reserved;
+    StateExportEconomy economy;
+    uint64_t padding;
+    StateExportRoom rooms[state_export_max_rooms];
+    StateExportAdventurer adventurers[state_export_max_adventurers];
+};
+
+struct StateExportSlot
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t padding[7]; //Keeps the sequence on its own cache line.
+    StateExportFrame frame;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "atomic must be a plain 64 bit value to be shared between processes");
+static_assert(sizeof(StateExportHeader) == 64, "StateExportHeader layout changed");
+static_assert(sizeof(StateExportEconomy) == 40, "StateExportEconomy layout changed");
+static_assert(sizeof(StateExportRoom) == 12, "StateExportRoom layout changed");
+static_assert(sizeof(StateExportAdventurer) == 32, "StateExportAdventurer layout changed");
+static_assert(sizeof(StateExportFrame) == 80 + state_export_max_rooms * 12 + state_export_max_adventurers * 32, "StateExportFrame layout changed");
+static_assert(sizeof(StateExportSlot) == 64 + sizeof(StateExportFrame), "StateExportSlot layout changed");
+
+static constexpr uint64_t state_export_size = sizeof(StateExportHeader) + sizeof(StateExportSlot) * state_export_slot_count;
+
+//Both sides of the protocol, shared by StateExporter, tools/stateReader.cpp and tools/stateExportTest.cpp.
+
+inline StateExportSlot& getStateExportSlot(StateExportHeader* header, uint64_t index)
+{
+    return reinterpret_cast<StateExportSlot*>(reinterpret_cast<uint8_t*>(header) + sizeof(StateExportHeader))[index];
+}
+
+inline const StateExportSlot& getStateExportSlot(const StateExportHeader* header, uint64_t index)
+{
+    return reinterpret_cast<const StateExportSlot*>(reinterpret_cast<const uint8_t*>(header) + header->header_size)[index];
+}
+
+//Fill in a new block of state_export_size bytes. The magic is written last, so readers never see a half initialized header.
+inline void initStateExport(StateExportHeader* header)
+{
+    memset(header->magic, 0, sizeof(header->magic));
+    header->version = state_export_version;
+    header->header_size = sizeof(StateExportHeader);
+    header->slot_size = sizeof(StateExportSlot);
+    header->slot_count = state_export_slot_count;
+    header->max_rooms = state_export_max_rooms;
+    header->max_adventurers = state_export_max_adventurers;
+    header->frame_count.store(0);
+    for(uint32_t n=0; n<state_export_slot_count; n++)
+        getStateExportSlot(header, n).sequence.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, state_export_magic, sizeof(header->magic));
+}
+
+//Writer: fill in the frame that beginStateExportFrame() returns, then publish it with endStateExportFrame().
+inline StateExportFrame& beginStateExportFrame(StateExportHeader* header)
+{
+    uint64_t frame_number = header->frame_count.load(std::memory_order_relaxed);
+    StateExportSlot& slot = getStateExportSlot(header, frame_number % state_export_slot_count);
+    slot.sequence.store(frame_number * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot.frame;
+}
+
+inline void endStateExportFrame(StateExportHeader* header)
+{
+    uint64_t frame_number = header->frame_count.load(std::memory_order_relaxed);
+    getStateExportSlot(header, frame_number % state_export_slot_count).sequence.store(frame_number * 2 + 2, std::memory_order_release);
+    header->frame_count.store(frame_number + 1, std::memory_order_release);
+}
+
+//Writer: set the rooms of a frame. for_each_room(add) calls add(room) for every room of the dungeon, it is called twice.
+//Rooms that are build come first, so when there are more rooms than fit only rooms that can still be dug are left out.
+template<typename F> void setStateExportRooms(StateExportFrame& frame, F for_each_room)
+{
+    frame.room_count = 0;
+    for(int pass=0; pass<2; pass++)
+    {
+        for_each_room([&frame, pass](const StateExportRoom& room)
+        {
+            if ((room.build != 0) != (pass == 0))
+                return;
+            if (frame.room_count == state_export_max_rooms)
+            {
+                frame.flags |= state_export_flag_rooms_truncated;
+                return;
+            }
+            frame.rooms[frame.room_count++] = room;
+        });
+    }
+}
+
+enum class StateExportRead
+{
+    Ok,
+    Empty, //Nothing was published yet.
+    Stalled, //No consistent frame within the timeout: the writer keeps overwriting the latest slot while it is read, or the block is corrupt.
+};
+
+//Reader: call read(frame_number, frame) on the latest frame until it gets a consistent copy. read must only copy what it needs,
+//the values can be torn, and are only valid when this returns Ok. Backs off while the writer is busy, and gives up after timeout.
+template<typename F> StateExportRead readLatestStateExportFrame(const StateExportHeader* header, F read, int& retries,
+    std::chrono::steady_clock::duration timeout=std::chrono::milliseconds(100))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for(int attempt=0; ; attempt++)
+    {
+        if (attempt > 0)
+        {
+            retries++;
+            if (std::chrono::steady_clock::now() > deadline)
+                return StateExportRead::Stalled;
+            if (attempt < 16)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        uint64_t frame_count = header->frame_count.load(std::memory_order_acquire);
+        if (frame_count == 0)
+            return StateExportRead::Empty;
+        uint64_t frame_number = frame_count - 1;
+        const StateExportSlot& slot = getStateExportSlot(header, frame_number % header->slot_count);
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != frame_number * 2 + 2)
+            continue;
+        read(frame_number, slot.frame);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+            return StateExportRead::Ok;
+    }
+}
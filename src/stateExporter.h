@@ -0,0 +1,144 @@
+#include "stateExportFormat.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Publishes the state of a dungeon every fixed update into a POSIX shared memory ring buffer, for monitoring tools in other processes.
+//The layout and the read protocol are described in stateExportFormat.h, tools/stateReader.cpp is a sample reader.
+//Frames are written in place, and the seqlock never makes the game wait for a reader.
+class StateExporter
+{
+public:
+    StateExporter(const sp::string& name)
+    : name(name)
+    {
+#ifdef _WIN32
+        LOG(Warning, "State export is only available on POSIX systems");
+#else
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            LOG(Warning, "Failed to create shared memory", name);
+            return;
+        }
+        if (ftruncate(fd, state_export_size) == 0)
+        {
+            void* ptr = mmap(nullptr, state_export_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED)
+                header = static_cast<StateExportHeader*>(ptr);
+        }
+        close(fd);
+        if (!header)
+        {
+            LOG(Warning, "Failed to map shared memory", name);
+            shm_unlink(name.c_str());
+            return;
+        }
+
+        initStateExport(header);
+        LOG(Info, "Exporting state to shared memory", name);
+#endif
+    }
+
+    ~StateExporter()
+    {
+#ifndef _WIN32
+        if (header)
+        {
+            munmap(header, state_export_size);
+            shm_unlink(name.c_str());
+        }
+#endif
+    }
+
+    bool isValid()
+    {
+        return header != nullptr;
+    }
+
+    //Write the state of a dungeon as the next frame. Called from the thread that runs the fixed updates of the dungeon.
+    void publish(GameSession& session, sp::P<sp::Node> root, bool day_running)
+    {
+        if (!header)
+            return;
+        StateExportFrame& frame = beginStateExportFrame(header);
+        frame.tick = session.timers.getTick();
+        frame.seed = session.seed;
+        frame.flags = day_running ? state_export_flag_day_running : 0;
+        frame.economy.money = session.money;
+        frame.economy.risk = session.risk;
+        frame.economy.reward = session.reward;
+        frame.economy.dragon_deception = session.dragon_deception;
+        frame.economy.placable_bodies = session.placable_bodies;
+        frame.economy.day = session.day;
+        frame.economy.deaths = session.deaths;
+        frame.economy.fled = session.fled;
+        frame.economy.escaped = session.escaped;
+        setStateExportRooms(frame, [&root](const std::function<void(const StateExportRoom&)>& add)
+        {
+            for(sp::P<DungeonRoom> room : root->getChildren())
+            {
+                if (!room)
+                    continue;
+                StateExportRoom export_room;
+                export_room.x = DungeonSnapshot::gridX(room->getPosition2D());
+                export_room.y = DungeonSnapshot::gridY(room->getPosition2D());
+                export_room.build = room->build;
+                export_room.entrance = room->entrance;
+                export_room.trap = room->main_object ? getTrapType(room->main_object->getAction()) : state_export_trap_none;
+                export_room.reserved = 0;
+                export_room.trap_state = room->main_object ? room->main_object->getState() : 0;
+                add(export_room);
+            }
+        });
+        frame.adventurer_count = 0;
+        for(sp::P<Adventurer> adventurer : root->getChildren())
+        {
+            if (adventurer)
+            {
+                if (frame.adventurer_count == state_export_max_adventurers)
+                {
+                    frame.flags |= state_export_flag_adventurers_truncated;
+                    continue;
+                }
+                StateExportAdventurer& export_adventurer = frame.adventurers[frame.adventurer_count++];
+                sp::Vector2d position = adventurer->getLogicalPosition();
+                export_adventurer.id = adventurer->id;
+                export_adventurer.level = adventurer->level;
+                export_adventurer.x = position.x;
+                export_adventurer.y = position.y;
+                export_adventurer.hp = adventurer->getHp();
+                export_adventurer.courage = adventurer->getCourage();
+                export_adventurer.fleeing = adventurer->isFleeing();
+                export_adventurer.slimed = adventurer->isSlimed();
+                export_adventurer.reserved[0] = export_adventurer.reserved[1] = 0;
+                export_adventurer.loot = adventurer->loot;
+            }
+        }
+
+        endStateExportFrame(header);
+    }
+
+private:
+    static StateExportTrap getTrapType(const sp::string& action)
+    {
+        if (action == "PIT")
+            return state_export_trap_pit;
+        if (action == "LOOT")
+            return state_export_trap_loot;
+        if (action == "FIRE")
+            return state_export_trap_fire;
+        if (action == "SLIME")
+            return state_export_trap_slime;
+        if (action == "BODY")
+            return state_export_trap_body;
+        return state_export_trap_none;
+    }
+
+    sp::string name;
+    StateExportHeader* header = nullptr;
+};
@@ -0,0 +1,89 @@
+#include <functional>
+
+//Hierarchical timer wheel that schedules callbacks a number of fixed updates in the future.
+//Scheduling is O(1), and advancing a tick only touches the events that are due (plus an occasional cascade),
+//so the cost does not depend on how many events are pending.
+//Every event has an owner node. When the owner is destroyed before the event is due, the event is dropped.
+class TimerWheel
+{
+public:
+    typedef std::function<void()> Callback;
+
+    //Schedule a callback delay ticks from now. A delay below 1 fires on the next tick.
+    void schedule(uint64_t delay, sp::P<sp::Node> owner, Callback callback)
+    {
+        if (delay < 1)
+            delay = 1;
+        insert(Event{current_tick + delay, owner, std::move(callback)});
+    }
+
+    uint64_t getTick()
+    {
+        return current_tick;
+    }
+
+    //Advance one tick and run all callbacks that are due on it.
+    void advance()
+    {
+        current_tick++;
+        for(int level=levels-1; level>0; level--)
+        {
+            if (current_tick & ((uint64_t(1) << (level * level_bits)) - 1))
+                continue;
+            if (level == levels - 1)
+            {
+                std::vector<Event> events;
+                events.swap(overflow);
+                for(auto& event : events)
+                    insert(std::move(event));
+            }
+            std::vector<Event> events;
+            events.swap(wheel[level][slotIndex(current_tick, level)]);
+            for(auto& event : events)
+                insert(std::move(event));
+        }
+
+        std::vector<Event> events;
+        events.swap(wheel[0][slotIndex(current_tick, 0)]);
+        for(auto& event : events)
+        {
+            if (event.owner)
+                event.callback();
+        }
+    }
+
+private:
+    static constexpr int level_bits = 6;
+    static constexpr int slot_count = 1 << level_bits;
+    static constexpr int levels = 4;
+
+    struct Event
+    {
+        uint64_t due;
+        sp::P<sp::Node> owner;
+        Callback callback;
+    };
+
+    static int slotIndex(uint64_t tick, int level)
+    {
+        return (tick >> (level * level_bits)) & (slot_count - 1);
+    }
+
+    void insert(Event&& event)
+    {
+        uint64_t delta = event.due > current_tick ? event.due - current_tick : 0;
+        for(int level=0; level<levels; level++)
+        {
+            if (delta < (uint64_t(1) << ((level + 1) * level_bits)))
+            {
+                wheel[level][slotIndex(event.due, level)].push_back(std::move(event));
+                return;
+            }
+        }
+        overflow.push_back(std::move(event));
+    }
+
+    uint64_t current_tick = 0;
+    std::vector<Event> wheel[levels][slot_count];
+    std::vector<Event> overflow;
+};
@@ -0,0 +1,71 @@
+//A handle to a single widget, resolved once by ID.
+//Values set on the binding are only pushed to the widget on apply() when they differ from the last pushed value,
+//so calling setVisible/setCaption every update does not trigger text layout or mesh rebuilds in the GUI.
+class WidgetBinding
+{
+public:
+    void bind(sp::P<sp::gui::Widget> root, const sp::string& id)
+    {
+        widget = root ? root->getWidgetWithID(id) : nullptr;
+        visible_pushed = false;
+        caption_pushed = false;
+    }
+
+    sp::P<sp::gui::Widget> get()
+    {
+        return widget;
+    }
+
+    void setVisible(bool visible)
+    {
+        this->visible = visible;
+        visible_set = true;
+    }
+
+    void show()
+    {
+        setVisible(true);
+    }
+
+    void hide()
+    {
+        setVisible(false);
+    }
+
+    void setCaption(const sp::string& caption)
+    {
+        this->caption = caption;
+        caption_set = true;
+    }
+
+    void apply()
+    {
+        if (!widget)
+            return;
+        if (visible_set && (!visible_pushed || visible != last_visible))
+        {
+            widget->setVisible(visible);
+            last_visible = visible;
+            visible_pushed = true;
+        }
+        if (caption_set && (!caption_pushed || caption != last_caption))
+        {
+            widget->setAttribute("caption", caption);
+            last_caption = caption;
+            caption_pushed = true;
+        }
+    }
+
+private:
+    sp::P<sp::gui::Widget> widget;
+
+    bool visible = true;
+    bool visible_set = false;
+    bool visible_pushed = false;
+    bool last_visible = true;
+
+    sp::string caption;
+    bool caption_set = false;
+    bool caption_pushed = false;
+    sp::string last_caption;
+};
@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//The world is drawn as text from a small fixed set of strings: the 16 room shapes, and the glyphs of objects and effects.
+//Shared with tools/bakeGlyphs.cpp, which bakes a glyph atlas and the meshes of all these strings into bakedGlyphs.h at build time.
+
+//Font and size the world text is made with.
+static constexpr const char* world_text_font = "gui/theme/NanumGothicCoding-Bold.ttf";
+static constexpr int world_text_pixel_size = 32;
+
+static const char* const world_glyph_strings[] = {"@", "^^^", "%", "&%$", "> <", "*", "\\|/"};
+
+std::string buildRoomString(bool up, bool down, bool left, bool right)
+{
+    std::string result;
+    if (up)
+        result += "  | |  \n +- -+ \n";
+    else
+        result += "       \n +---+ \n";
+    if (left && right)
+        result += "-|   |-\n       \n-|   |-\n";
+    else if (left)
+        result += "-|   | \n     | \n-|   | \n";
+    else if (right)
+        result += " |   |-\n |     \n |   |-\n";
+    else
+        result += " |   | \n |   | \n |   | \n";
+    if (down)
+        result += " +- -+ \n  | |  ";
+    else
+        result += " +---+ \n       ";
+    return result;
+}
+
+//Every string the world uses.
+std::vector<std::string> getWorldStrings()
+{
+    std::vector<std::string> result;
+    for(int n=0; n<16; n++)
+        result.push_back(buildRoomString(n & 1, n & 2, n & 4, n & 8));
+    for(const char* str : world_glyph_strings)
+        result.push_back(str);
+    return result;
+}
+
+//A corner of a glyph quad in a baked string. Positions are centered on the string, in world units, uv is in the baked atlas.
+//Every 4 vertices are a quad: top left, bottom left, top right, bottom right.
+struct BakedGlyphVertex
+{
+    float x;
+    float y;
+    float u;
+    float v;
+};
+
+struct BakedString
+{
+    const char* text;
+    const BakedGlyphVertex* vertices;
+    int quad_count;
+};
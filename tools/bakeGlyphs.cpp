@@ -0,0 +1,187 @@
+//Bakes the world text into a header: a glyph atlas with every character the world strings use, and a mesh per string.
+//The game builds its text meshes from these tables, so it never loads the font or rasterizes glyphs at startup.
+//The strings, font and size come from src/worldText.h. Strings are laid out like sp::Font::prepare() with TopLeft alignment,
+//then centered and squashed vertically, as buildString() used to do at runtime.
+//Usage: bakeGlyphs <font file> <output header>
+#include "../src/worldText.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+static constexpr int atlas_width = 128;
+static constexpr int atlas_padding = 1;
+//Text size of 1.0: one world unit per pixel_size pixels.
+static constexpr float world_scale = 1.0f / world_text_pixel_size;
+static constexpr float vertical_squash = 0.8f;
+
+struct Glyph
+{
+    int width;
+    int height;
+    int left; //Bearing from the pen position to the left of the bitmap.
+    int top; //Bearing from the baseline up to the top of the bitmap.
+    int advance;
+    int atlas_x;
+    int atlas_y;
+    std::vector<uint8_t> alpha;
+};
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <font file> <output header>" << std::endl;
+        return 1;
+    }
+
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) || FT_New_Face(library, argv[1], 0, &face) || FT_Set_Pixel_Sizes(face, 0, world_text_pixel_size))
+    {
+        std::cerr << "Failed to load font " << argv[1] << std::endl;
+        return 1;
+    }
+    int ascender = face->size->metrics.ascender >> 6;
+    int line_height = face->size->metrics.height >> 6;
+
+    std::vector<std::string> strings = getWorldStrings();
+    std::map<char, Glyph> glyphs;
+    for(auto& str : strings)
+    {
+        for(char c : str)
+        {
+            if (c == '\n' || glyphs.find(c) != glyphs.end())
+                continue;
+            if (FT_Load_Char(face, static_cast<unsigned char>(c), FT_LOAD_RENDER))
+            {
+                std::cerr << "Font has no glyph for '" << c << "'" << std::endl;
+                return 1;
+            }
+            FT_GlyphSlot slot = face->glyph;
+            Glyph glyph{int(slot->bitmap.width), int(slot->bitmap.rows), slot->bitmap_left, slot->bitmap_top, int(slot->advance.x >> 6), 0, 0, {}};
+            for(int y=0; y<glyph.height; y++)
+                glyph.alpha.insert(glyph.alpha.end(), slot->bitmap.buffer + y * slot->bitmap.pitch, slot->bitmap.buffer + y * slot->bitmap.pitch + glyph.width);
+            glyphs[c] = glyph;
+        }
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+
+    //Shelf packing, the glyph set is small.
+    int x = atlas_padding, y = atlas_padding, shelf_height = 0;
+    for(auto& it : glyphs)
+    {
+        Glyph& glyph = it.second;
+        if (x + glyph.width + atlas_padding > atlas_width)
+        {
+            x = atlas_padding;
+            y += shelf_height + atlas_padding;
+            shelf_height = 0;
+        }
+        glyph.atlas_x = x;
+        glyph.atlas_y = y;
+        x += glyph.width + atlas_padding;
+        shelf_height = std::max(shelf_height, glyph.height);
+    }
+    int atlas_height = 1;
+    while(atlas_height < y + shelf_height + atlas_padding)
+        atlas_height *= 2;
+    std::vector<uint8_t> atlas(atlas_width * atlas_height, 0);
+    for(auto& it : glyphs)
+    {
+        const Glyph& glyph = it.second;
+        for(int row=0; row<glyph.height; row++)
+            std::copy(glyph.alpha.begin() + row * glyph.width, glyph.alpha.begin() + (row + 1) * glyph.width, atlas.begin() + (glyph.atlas_y + row) * atlas_width + glyph.atlas_x);
+    }
+
+    std::ofstream out(argv[2], std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << argv[2] << " for writing" << std::endl;
+        return 1;
+    }
+    char buffer[128];
+    out << "//Generated by tools/bakeGlyphs.cpp from " << world_text_font << ", do not edit.\n";
+    out << "static constexpr int baked_glyph_atlas_width = " << atlas_width << ";\n";
+    out << "static constexpr int baked_glyph_atlas_height = " << atlas_height << ";\n";
+    out << "//Coverage of every atlas pixel, row by row from the top.\n";
+    out << "static constexpr uint8_t baked_glyph_atlas[] = {";
+    for(size_t n=0; n<atlas.size(); n++)
+        out << (n % 32 == 0 ? "\n    " : "") << int(atlas[n]) << ",";
+    out << "\n};\n";
+
+    std::vector<size_t> quad_counts;
+    for(size_t index=0; index<strings.size(); index++)
+    {
+        const std::string& str = strings[index];
+        std::vector<BakedGlyphVertex> vertices;
+        int pen_x = 0, width = 0, line = 0;
+        for(char c : str)
+        {
+            if (c == '\n')
+            {
+                pen_x = 0;
+                line++;
+                continue;
+            }
+            const Glyph& glyph = glyphs[c];
+            if (glyph.width > 0 && glyph.height > 0)
+            {
+                float left = pen_x + glyph.left;
+                float top = -(ascender + line * line_height) + glyph.top;
+                float u0 = float(glyph.atlas_x) / atlas_width, u1 = float(glyph.atlas_x + glyph.width) / atlas_width;
+                float v0 = float(glyph.atlas_y) / atlas_height, v1 = float(glyph.atlas_y + glyph.height) / atlas_height;
+                vertices.push_back({left, top, u0, v0});
+                vertices.push_back({left, top - glyph.height, u0, v1});
+                vertices.push_back({left + glyph.width, top, u1, v0});
+                vertices.push_back({left + glyph.width, top - glyph.height, u1, v1});
+            }
+            pen_x += glyph.advance;
+            width = std::max(width, pen_x);
+        }
+        int height = (line + 1) * line_height;
+        quad_counts.push_back(vertices.size() / 4);
+
+        out << "static constexpr BakedGlyphVertex baked_string_" << index << "[] = {";
+        for(auto& v : vertices)
+        {
+            float vx = (v.x - width * 0.5f) * world_scale;
+            float vy = (v.y + height * 0.5f) * world_scale * vertical_squash;
+            snprintf(buffer, sizeof(buffer), "\n    {%.6ff, %.6ff, %.6ff, %.6ff},", vx, vy, v.u, v.v);
+            out << buffer;
+        }
+        if (vertices.empty())
+            out << "{0.0f, 0.0f, 0.0f, 0.0f}";
+        out << "\n};\n";
+    }
+
+    out << "static constexpr BakedString baked_strings[] = {\n";
+    for(size_t index=0; index<strings.size(); index++)
+    {
+        out << "    {\"";
+        for(char c : strings[index])
+        {
+            if (c == '\n')
+                out << "\\n";
+            else if (c == '\\' || c == '"')
+                out << '\\' << c;
+            else
+                out << c;
+        }
+        out << "\", baked_string_" << index << ", " << quad_counts[index] << "},\n";
+    }
+    out << "};\n";
+    if (!out)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}
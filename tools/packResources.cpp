@@ -0,0 +1,101 @@
+//Packs a resource directory into a single indexed archive that can be served by PackResourceProvider.
+//Usage: packResources <resource directory> <output file>
+#include "../src/packFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct InputFile
+{
+    std::string name;
+    fs::path path;
+    uint64_t size;
+    int64_t modify_time;
+};
+
+static int64_t toUnixTime(fs::file_time_type time)
+{
+    auto system_time = std::chrono::time_point_cast<std::chrono::system_clock::duration>(time - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+    return std::chrono::duration_cast<std::chrono::seconds>(system_time.time_since_epoch()).count();
+}
+
+static uint64_t align(uint64_t offset)
+{
+    return (offset + pack_data_alignment - 1) / pack_data_alignment * pack_data_alignment;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <resource directory> <output file>" << std::endl;
+        return 1;
+    }
+    fs::path root = argv[1];
+
+    std::vector<InputFile> files;
+    for(auto& entry : fs::recursive_directory_iterator(root))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        files.push_back({entry.path().lexically_relative(root).generic_string(), entry.path(), entry.file_size(), toUnixTime(entry.last_write_time())});
+    }
+    std::sort(files.begin(), files.end(), [](const InputFile& a, const InputFile& b) { return a.name < b.name; });
+
+    PackHeader header;
+    memcpy(header.magic, pack_magic, sizeof(header.magic));
+    header.version = pack_version;
+    header.entry_count = files.size();
+    header.name_table_size = 0;
+    for(auto& file : files)
+        header.name_table_size += file.name.size();
+
+    std::vector<PackEntry> entries;
+    uint32_t name_offset = 0;
+    uint64_t data_offset = align(sizeof(PackHeader) + sizeof(PackEntry) * files.size() + header.name_table_size);
+    for(auto& file : files)
+    {
+        entries.push_back({data_offset, file.size, file.modify_time, name_offset, uint32_t(file.name.size())});
+        name_offset += file.name.size();
+        data_offset = align(data_offset + file.size);
+    }
+
+    std::ofstream out(argv[2], std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << argv[2] << " for writing" << std::endl;
+        return 1;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), sizeof(PackEntry) * entries.size());
+    for(auto& file : files)
+        out.write(file.name.data(), file.name.size());
+    for(size_t n=0; n<files.size(); n++)
+    {
+        std::vector<char> padding(entries[n].data_offset - uint64_t(out.tellp()), 0);
+        out.write(padding.data(), padding.size());
+
+        std::ifstream in(files[n].path, std::ios::binary);
+        std::vector<char> data(files[n].size);
+        if (!in.read(data.data(), data.size()))
+        {
+            std::cerr << "Failed to read " << files[n].path << std::endl;
+            return 1;
+        }
+        out.write(data.data(), data.size());
+    }
+    if (!out)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}
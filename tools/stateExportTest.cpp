@@ -0,0 +1,206 @@
+//Checks the seqlock protocol of src/stateExportFormat.h: a writer thread publishes frames as fast as it can while a reader
+//takes the latest one. Every field of a frame is derived from its frame number, so a torn read that passes the sequence check
+//shows up as a frame that does not match its number. Also checks that frame numbers never go back, that a slot that
+//never becomes consistent makes the reader give up instead of spinning, and what is kept of a dungeon with more rooms than fit.
+//Usage: stateExportTest [frame count]
+#include "../src/stateExportFormat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+//The room and adventurer counts cycle, so the reader copies frames of every size.
+static void fillFrame(StateExportFrame& frame, uint64_t frame_number)
+{
+    frame.tick = frame_number * 3;
+    frame.seed = uint32_t(frame_number);
+    frame.flags = uint32_t(frame_number) & state_export_flag_day_running;
+    frame.room_count = uint32_t(frame_number % (state_export_max_rooms + 1));
+    frame.adventurer_count = uint32_t(frame_number % (state_export_max_adventurers + 1));
+    frame.economy.money = int32_t(frame_number);
+    frame.economy.day = int32_t(frame_number / 7);
+    for(uint32_t n=0; n<frame.room_count; n++)
+    {
+        frame.rooms[n].x = int16_t(frame_number + n);
+        frame.rooms[n].y = int16_t(frame_number);
+        frame.rooms[n].trap_state = int32_t(frame_number);
+    }
+    for(uint32_t n=0; n<frame.adventurer_count; n++)
+    {
+        frame.adventurers[n].id = uint32_t(frame_number + n);
+        frame.adventurers[n].hp = int32_t(frame_number);
+    }
+}
+
+static bool checkFrame(const StateExportFrame& frame, uint64_t frame_number)
+{
+    if (frame.tick != frame_number * 3 || frame.seed != uint32_t(frame_number) || frame.flags != (uint32_t(frame_number) & state_export_flag_day_running)
+        || frame.room_count != frame_number % (state_export_max_rooms + 1) || frame.adventurer_count != frame_number % (state_export_max_adventurers + 1)
+        || frame.economy.money != int32_t(frame_number) || frame.economy.day != int32_t(frame_number / 7))
+        return false;
+    for(uint32_t n=0; n<frame.room_count; n++)
+    {
+        if (frame.rooms[n].x != int16_t(frame_number + n) || frame.rooms[n].y != int16_t(frame_number) || frame.rooms[n].trap_state != int32_t(frame_number))
+            return false;
+    }
+    for(uint32_t n=0; n<frame.adventurer_count; n++)
+    {
+        if (frame.adventurers[n].id != uint32_t(frame_number + n) || frame.adventurers[n].hp != int32_t(frame_number))
+            return false;
+    }
+    return true;
+}
+
+//What the reader copies out, like tools/stateReader.cpp does.
+struct Copy
+{
+    uint64_t frame_number;
+    StateExportFrame frame;
+};
+
+static StateExportRead readLatest(const StateExportHeader* header, Copy& copy, int& retries)
+{
+    return readLatestStateExportFrame(header, [&copy](uint64_t frame_number, const StateExportFrame& frame)
+    {
+        copy.frame_number = frame_number;
+        copy.frame.tick = frame.tick;
+        copy.frame.seed = frame.seed;
+        copy.frame.flags = frame.flags;
+        copy.frame.economy = frame.economy;
+        copy.frame.room_count = std::min(frame.room_count, state_export_max_rooms);
+        copy.frame.adventurer_count = std::min(frame.adventurer_count, state_export_max_adventurers);
+        std::copy(frame.rooms, frame.rooms + copy.frame.room_count, copy.frame.rooms);
+        std::copy(frame.adventurers, frame.adventurers + copy.frame.adventurer_count, copy.frame.adventurers);
+    }, retries);
+}
+
+//A dungeon with more rooms than a frame holds, every third room build. All build rooms must arrive, ahead of the others.
+static bool checkRoomsPastCap(StateExportHeader* header, Copy& copy)
+{
+    const uint32_t room_count = state_export_max_rooms + 1000;
+    StateExportFrame& frame = beginStateExportFrame(header);
+    frame.flags = 0;
+    frame.adventurer_count = 0;
+    setStateExportRooms(frame, [room_count](const std::function<void(const StateExportRoom&)>& add)
+    {
+        for(uint32_t n=0; n<room_count; n++)
+        {
+            StateExportRoom room{int16_t(n), 0, uint8_t(n % 3 == 0), 0, state_export_trap_none, 0, 0};
+            add(room);
+        }
+    });
+    endStateExportFrame(header);
+
+    int retries = 0;
+    if (readLatest(header, copy, retries) != StateExportRead::Ok)
+        return false;
+    const uint32_t build_count = (room_count + 2) / 3;
+    if (copy.frame.room_count != state_export_max_rooms || !(copy.frame.flags & state_export_flag_rooms_truncated))
+        return false;
+    for(uint32_t n=0; n<copy.frame.room_count; n++)
+    {
+        const StateExportRoom& room = copy.frame.rooms[n];
+        if (n < build_count && (!room.build || room.x != int16_t(n * 3)))
+            return false;
+        if (n >= build_count && room.build)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t frame_count = 200000;
+    if (argc > 1)
+        frame_count = std::max<uint64_t>(1, std::strtoull(argv[1], nullptr, 10));
+
+    std::unique_ptr<uint64_t[]> block(new uint64_t[(state_export_size + 7) / 8]());
+    StateExportHeader* header = reinterpret_cast<StateExportHeader*>(block.get());
+    initStateExport(header);
+
+    std::unique_ptr<Copy> copy(new Copy());
+    int retries = 0;
+    if (readLatest(header, *copy, retries) != StateExportRead::Empty)
+    {
+        std::cerr << "A new block is not empty" << std::endl;
+        return 1;
+    }
+
+    std::atomic<bool> done{false};
+    std::thread writer([header, frame_count, &done]()
+    {
+        for(uint64_t n=0; n<frame_count; n++)
+        {
+            fillFrame(beginStateExportFrame(header), n);
+            endStateExportFrame(header);
+        }
+        done.store(true);
+    });
+
+    uint64_t reads = 0, stalls = 0;
+    bool have_frame = false, failed = false;
+    uint64_t last_frame = 0;
+    while(!failed)
+    {
+        bool finished = done.load();
+        StateExportRead status = readLatest(header, *copy, retries);
+        if (status == StateExportRead::Ok)
+        {
+            reads++;
+            if (have_frame && copy->frame_number < last_frame)
+            {
+                std::cerr << "Frame " << copy->frame_number << " read after frame " << last_frame << std::endl;
+                failed = true;
+            }
+            if (!checkFrame(copy->frame, copy->frame_number))
+            {
+                std::cerr << "Frame " << copy->frame_number << " is torn" << std::endl;
+                failed = true;
+            }
+            last_frame = copy->frame_number;
+            have_frame = true;
+        }
+        else if (status == StateExportRead::Stalled)
+        {
+            //The writer can lap a reader that is descheduled for the whole timeout, that is not a protocol error.
+            stalls++;
+        }
+        if (finished)
+            break;
+    }
+    writer.join();
+    if (failed)
+        return 1;
+    if (!have_frame || last_frame != frame_count - 1)
+    {
+        std::cerr << "Last frame read is " << last_frame << ", expected " << frame_count - 1 << std::endl;
+        return 1;
+    }
+    std::cout << reads << " consistent reads of " << frame_count << " frames, " << retries << " retries, " << stalls << " timeouts" << std::endl;
+
+    //A latest slot that never shows the sequence of its frame, as in a corrupt block, must make the reader give up.
+    getStateExportSlot(header, last_frame % state_export_slot_count).sequence.store(last_frame * 2 + 1);
+    retries = 0;
+    auto start = std::chrono::steady_clock::now();
+    StateExportRead status = readLatest(header, *copy, retries);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (status != StateExportRead::Stalled || elapsed > std::chrono::seconds(5))
+    {
+        std::cerr << "Reader did not report a stalled writer" << std::endl;
+        return 1;
+    }
+    std::cout << "Stalled writer reported after " << retries << " retries" << std::endl;
+
+    initStateExport(header);
+    if (!checkRoomsPastCap(header, *copy))
+    {
+        std::cerr << "Build rooms are missing from a truncated frame" << std::endl;
+        return 1;
+    }
+    std::cout << "Truncated frame keeps all build rooms" << std::endl;
+    return 0;
+}
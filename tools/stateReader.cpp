@@ -0,0 +1,181 @@
+//Sample reader for the shared memory state export of the game (start the game with --export-state).
+//Follows the protocol described in src/stateExportFormat.h, and prints the latest frame once per second.
+//Usage: stateReader [shared memory name] [--once]
+#include "../src/stateExportFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* trap_names[] = {"", "pit", "loot", "fire", "slime", "body"};
+static const char trap_symbols[] = {' ', '^', '%', '>', '&', '@'};
+
+//What we take out of a frame. A real dashboard could use the fields in place, this copies a few to print them after the check.
+struct Summary
+{
+    uint64_t frame_number;
+    StateExportFrame frame;
+};
+
+static const StateExportHeader* openExport(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    void* ptr = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && uint64_t(info.st_size) >= state_export_size)
+        ptr = mmap(nullptr, state_export_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return nullptr;
+    const StateExportHeader* header = static_cast<const StateExportHeader*>(ptr);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (memcmp(header->magic, state_export_magic, sizeof(header->magic)) != 0 || header->version != state_export_version
+        || header->header_size != sizeof(StateExportHeader) || header->slot_size != sizeof(StateExportSlot)
+        || header->slot_count != state_export_slot_count)
+    {
+        std::cerr << "Shared memory " << name << " is not a version " << state_export_version << " state export" << std::endl;
+        munmap(ptr, state_export_size);
+        return nullptr;
+    }
+    return header;
+}
+
+//Read the latest frame under the seqlock.
+static StateExportRead readLatest(const StateExportHeader* header, Summary& summary, int& retries)
+{
+    return readLatestStateExportFrame(header, [&summary](uint64_t frame_number, const StateExportFrame& frame)
+    {
+        summary.frame_number = frame_number;
+        summary.frame.tick = frame.tick;
+        summary.frame.seed = frame.seed;
+        summary.frame.flags = frame.flags;
+        summary.frame.economy = frame.economy;
+        summary.frame.room_count = std::min(frame.room_count, state_export_max_rooms);
+        summary.frame.adventurer_count = std::min(frame.adventurer_count, state_export_max_adventurers);
+        std::copy(frame.rooms, frame.rooms + summary.frame.room_count, summary.frame.rooms);
+        std::copy(frame.adventurers, frame.adventurers + summary.frame.adventurer_count, summary.frame.adventurers);
+    }, retries);
+}
+
+static void print(const Summary& summary)
+{
+    const StateExportFrame& frame = summary.frame;
+    const StateExportEconomy& economy = frame.economy;
+    std::cout << "frame " << summary.frame_number << " tick " << frame.tick << " seed " << frame.seed
+        << " day " << economy.day << ((frame.flags & state_export_flag_day_running) ? " (running)" : " (building)") << std::endl;
+    std::cout << "money " << economy.money << " risk " << economy.risk << " reward " << economy.reward << " deception " << economy.dragon_deception
+        << " bodies " << economy.placable_bodies << " deaths " << economy.deaths << " fled " << economy.fled << " escaped " << economy.escaped << std::endl;
+
+    //Rooms as a map, one character per room: # build, . can be dug, or the symbol of the trap in it.
+    std::map<std::pair<int, int>, char> grid;
+    int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+    for(uint32_t n=0; n<frame.room_count; n++)
+    {
+        const StateExportRoom& room = frame.rooms[n];
+        char symbol = room.build ? '#' : '.';
+        if (room.trap > 0 && room.trap < sizeof(trap_symbols))
+            symbol = trap_symbols[room.trap];
+        grid[{room.x, room.y}] = symbol;
+        min_x = std::min(min_x, int(room.x));
+        max_x = std::max(max_x, int(room.x));
+        min_y = std::min(min_y, int(room.y));
+        max_y = std::max(max_y, int(room.y));
+    }
+    for(int y=max_y; y>=min_y; y--)
+    {
+        std::string line = "  ";
+        for(int x=min_x; x<=max_x; x++)
+        {
+            auto it = grid.find({x, y});
+            line += it != grid.end() ? it->second : ' ';
+        }
+        std::cout << line << std::endl;
+    }
+    for(uint32_t n=0; n<frame.room_count; n++)
+    {
+        const StateExportRoom& room = frame.rooms[n];
+        if (room.trap > 0 && room.trap < sizeof(trap_symbols))
+            std::cout << "  " << trap_names[room.trap] << " at " << room.x << "," << room.y << " state " << room.trap_state << std::endl;
+    }
+    for(uint32_t n=0; n<frame.adventurer_count; n++)
+    {
+        const StateExportAdventurer& adventurer = frame.adventurers[n];
+        std::cout << "  adventurer " << adventurer.id << " level " << adventurer.level << " at " << adventurer.x << "," << adventurer.y
+            << " hp " << adventurer.hp << " courage " << adventurer.courage << " loot " << adventurer.loot
+            << (adventurer.fleeing ? " fleeing" : "") << (adventurer.slimed ? " slimed" : "") << std::endl;
+    }
+    if (frame.flags & (state_export_flag_rooms_truncated | state_export_flag_adventurers_truncated))
+        std::cout << "  (truncated)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string name = state_export_default_name;
+    bool once = false;
+    for(int n=1; n<argc; n++)
+    {
+        std::string arg = argv[n];
+        if (arg == "--once")
+            once = true;
+        else
+            name = arg;
+    }
+
+    const StateExportHeader* header = openExport(name);
+    if (!header)
+    {
+        std::cerr << "Could not open " << name << ", is the game running with --export-state?" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<Summary> summary(new Summary());
+    uint64_t last_frame = 0;
+    bool have_frame = false;
+    bool stalled = false;
+    while(true)
+    {
+        int retries = 0;
+        StateExportRead status = readLatest(header, *summary, retries);
+        if (status == StateExportRead::Stalled)
+        {
+            std::cerr << "Writer stalled, no consistent frame after " << retries << " retries" << std::endl;
+            if (once)
+                return 1;
+        }
+        else if (status == StateExportRead::Ok)
+        {
+            if (!have_frame || summary->frame_number != last_frame)
+            {
+                print(*summary);
+                if (retries)
+                    std::cout << "  (" << retries << " retries)" << std::endl;
+                stalled = false;
+            }
+            else if (!stalled)
+            {
+                //The game publishes every fixed update, also while building, so a frame that does not change means the writer stopped.
+                std::cout << "Writer stalled at frame " << last_frame << std::endl;
+                stalled = true;
+            }
+            last_frame = summary->frame_number;
+            have_frame = true;
+            if (once)
+                return 0;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}